@@ -17,16 +17,278 @@
 #define _GNU_SOURCE
 
 #include <assert.h>
+#include <getopt.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "romdb.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+# include <immintrin.h>
+#endif
+
 #define PRINTERR()	\
 	fprintf(stderr, "ERR %s:%d %s\n", __func__, __LINE__, strerror(errno))
 
+/* Allocations from an arena are aligned to this many bytes. */
+#define ARENA_ALIGN		16
+#define ARENA_CHUNK_SIZE	(1024 * 1024)
+/* Allocations larger than this get a chunk of their own. */
+#define ARENA_LARGE		(ARENA_CHUNK_SIZE / 4)
+
+/**
+ * Chunk of memory of an arena. Chunks are linked in both directions, so that
+ * the chunk of a large allocation can be reallocated.
+ */
+struct arena_chunk_s
+{
+	struct arena_chunk_s *prev;
+	struct arena_chunk_s *next;
+	size_t size;
+};
+
+#define ARENA_HDR	((sizeof(struct arena_chunk_s) + ARENA_ALIGN - 1) & \
+			~(size_t)(ARENA_ALIGN - 1))
+
+/**
+ * Bump allocator for data that lives until the end of the conversion. Memory
+ * is only released all at once by arena_free(). Small allocations are carved
+ * from shared chunks, and the latest of them can be grown in place; large
+ * allocations get their own chunk. Memory returned is zeroed.
+ * An arena may only be used by one thread at a time.
+ */
+struct arena_s
+{
+	/* Most recent shared chunk; large chunks are linked before it. */
+	struct arena_chunk_s *chunk;
+	unsigned char *next;
+	unsigned char *end;
+	/* Latest allocation from the shared chunk. */
+	unsigned char *last;
+
+	size_t allocs;
+	size_t requested;
+};
+
+/**
+ * Totals of all arenas, for --stats. The bytes held in chunks are updated by
+ * any thread; the rest only when an arena is freed.
+ */
+static struct
+{
+	size_t held;
+	size_t peak;
+	size_t reserved;
+	size_t chunks;
+	size_t allocs;
+	size_t requested;
+} arena_stats;
+
+static size_t arena_round(size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/**
+ * Account for add bytes of chunks allocated and sub bytes released.
+ */
+static void arena_held(size_t add, size_t sub)
+{
+	size_t held = __atomic_add_fetch(&arena_stats.held, add - sub,
+			__ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&arena_stats.peak, __ATOMIC_RELAXED);
+
+	if(add > sub)
+	{
+		__atomic_add_fetch(&arena_stats.reserved, add - sub,
+				__ATOMIC_RELAXED);
+	}
+
+	while(held > peak && !__atomic_compare_exchange_n(&arena_stats.peak,
+				&peak, held, 1, __ATOMIC_RELAXED,
+				__ATOMIC_RELAXED))
+		;
+}
+
+/**
+ * Allocate a chunk with size bytes of data, and link it before the shared
+ * chunk.
+ */
+static struct arena_chunk_s *arena_chunk(struct arena_s *a, size_t size)
+{
+	struct arena_chunk_s *c = calloc(1, ARENA_HDR + size);
+
+	assert(c != NULL);
+	c->size = size;
+	arena_held(ARENA_HDR + size, 0);
+	__atomic_add_fetch(&arena_stats.chunks, 1, __ATOMIC_RELAXED);
+
+	if(a->chunk != NULL)
+	{
+		c->prev = a->chunk->prev;
+		c->next = a->chunk;
+		if(c->prev != NULL)
+			c->prev->next = c;
+		a->chunk->prev = c;
+	}
+
+	return c;
+}
+
+static void arena_init(struct arena_s *a)
+{
+	memset(a, 0, sizeof(*a));
+}
+
+static void *arena_alloc(struct arena_s *a, size_t size)
+{
+	const size_t rounded = arena_round(size);
+	struct arena_chunk_s *c;
+
+	a->allocs++;
+	a->requested += size;
+
+	if(rounded > ARENA_LARGE)
+	{
+		c = arena_chunk(a, rounded);
+		if(a->chunk == NULL)
+			a->chunk = c;
+
+		return (unsigned char *)c + ARENA_HDR;
+	}
+
+	if(rounded > (size_t)(a->end - a->next))
+	{
+		c = arena_chunk(a, ARENA_CHUNK_SIZE);
+
+		/* Move the new chunk after the current one, making it the
+		 * shared chunk. */
+		if(a->chunk != NULL)
+		{
+			if(c->prev != NULL)
+				c->prev->next = c->next;
+			a->chunk->prev = c->prev;
+			c->prev = a->chunk;
+			c->next = NULL;
+			a->chunk->next = c;
+		}
+
+		a->chunk = c;
+		a->next = (unsigned char *)c + ARENA_HDR;
+		a->end = a->next + ARENA_CHUNK_SIZE;
+	}
+
+	a->last = a->next;
+	a->next += rounded;
+	return a->last;
+}
+
+/**
+ * Grow an allocation of old bytes to size bytes, keeping its contents.
+ */
+static void *arena_grow(struct arena_s *a, void *p, size_t old, size_t size)
+{
+	const size_t rounded = arena_round(size);
+	unsigned char *q;
+
+	if(p == NULL)
+		return arena_alloc(a, size);
+
+	/* A large allocation is the only one in its chunk. */
+	if(arena_round(old) > ARENA_LARGE)
+	{
+		struct arena_chunk_s *c = (void *)((unsigned char *)p -
+				ARENA_HDR);
+		struct arena_chunk_s *n = realloc(c, ARENA_HDR + rounded);
+
+		assert(n != NULL);
+		a->requested += size - old;
+		arena_held(rounded, n->size);
+		memset((unsigned char *)n + ARENA_HDR + n->size, 0,
+				rounded - n->size);
+		n->size = rounded;
+		if(n->prev != NULL)
+			n->prev->next = n;
+		if(n->next != NULL)
+			n->next->prev = n;
+		if(a->chunk == c)
+			a->chunk = n;
+
+		return (unsigned char *)n + ARENA_HDR;
+	}
+
+	/* The latest small allocation can be extended in place. */
+	if(p == a->last && rounded <= ARENA_LARGE &&
+			rounded <= (size_t)(a->end - a->last))
+	{
+		a->requested += size - old;
+		a->next = a->last + rounded;
+		return p;
+	}
+
+	q = arena_alloc(a, size);
+	memcpy(q, p, old);
+	return q;
+}
+
+/**
+ * Release all memory of the arena.
+ */
+static void arena_free(struct arena_s *a)
+{
+	/* The shared chunk is the last in the list. */
+	struct arena_chunk_s *c = a->chunk;
+
+	while(c != NULL)
+	{
+		struct arena_chunk_s *prev = c->prev;
+
+		arena_held(0, ARENA_HDR + c->size);
+		free(c);
+		c = prev;
+	}
+
+	arena_stats.allocs += a->allocs;
+	arena_stats.requested += a->requested;
+	arena_init(a);
+}
+
+/* Allocation from an arena, or from the heap if arena is NULL. */
+static void *mem_alloc(struct arena_s *arena, size_t size)
+{
+	void *p = arena != NULL ? arena_alloc(arena, size) : calloc(1, size);
+
+	assert(p != NULL);
+	return p;
+}
+
+static void *mem_grow(struct arena_s *arena, void *p, size_t old, size_t size)
+{
+	if(arena != NULL)
+		return arena_grow(arena, p, old, size);
+
+	p = realloc(p, size);
+	assert(p != NULL);
+	return p;
+}
+
+static void mem_free(struct arena_s *arena, void *p)
+{
+	if(arena == NULL)
+		free(p);
+}
+
 enum save_types_e
 {
 	SAVE_EEPROM_4KB,
@@ -42,691 +304,5318 @@ const char *save_types_str[] = {
 	"SAVE_CONTROLLER_PACK", "SAVE_NONE"
 };
 
-struct rom_entry_s
+union rom_conf_u
 {
-	uint64_t crc;
-
-	union rom_conf_u
+	struct
 	{
-		struct
-		{
-			/* Unused value allows for packing entry in exactly 4
-			 * bytes. */
-			unsigned char do_not_use : 1;
-			unsigned char save_type : 3;
-			unsigned char players : 3;
-			unsigned char rumble : 1;
+		/* Unused value allows for packing entry in exactly 4
+		 * bytes. */
+		unsigned char do_not_use : 1;
+		unsigned char save_type : 3;
+		unsigned char players : 3;
+		unsigned char rumble : 1;
 
-			unsigned char transferpak : 1;
-			unsigned char status : 3;
-			unsigned char count_per_op : 3;
-			unsigned char disable_extra_mem : 1;
+		unsigned char transferpak : 1;
+		unsigned char status : 3;
+		unsigned char count_per_op : 3;
+		unsigned char disable_extra_mem : 1;
 
-			/* Actual cheat data isn't stored in rom data entry, but
-			 * in a look-up table. This value is the index for the
-			 * cheats look-up table. */
-			unsigned char cheat_lut : 5;
+		/* Actual cheat data isn't stored in rom data entry, but
+		 * in a look-up table. The index for the cheats look-up
+		 * table is kept in rom_table_s.cheat, and only written
+		 * into these bits and cheat_lut_hi on output. */
+		unsigned char cheat_lut : 5;
 
-			unsigned char mempak : 1;
-			unsigned char biopak : 1;
+		unsigned char mempak : 1;
+		unsigned char biopak : 1;
 
-			/* Only Tetris 64 requires this. If 1, then set to
-			 * 0x100, otherwise the default of 0x900 is assumed. */
-			unsigned char si_dma_duration : 1;
+		/* Only Tetris 64 requires this. If 1, then set to
+		 * 0x100, otherwise the default of 0x900 is assumed. */
+		unsigned char si_dma_duration : 1;
 
-			/* Only "Hey You, Pikachu!" uses this. If set, then
-			 * aidmamodifier should be set to 88. */
-			unsigned char ai_dma_modifier : 1;
-		};
-		struct
-		{
-			/* Does this entry refer to another entry?
-			* If it does, look up the rom entry at value reference_entry. */
-			unsigned char reference : 1;
-			uint16_t reference_entry;
-		};
-	} conf;
+		/* Only "Hey You, Pikachu!" uses this. If set, then
+		 * aidmamodifier should be set to 88. */
+		unsigned char ai_dma_modifier : 1;
 
+		/* Upper bits of the cheat index. */
+		unsigned char cheat_lut_hi : 7;
+	};
 	struct
 	{
-		char md5[33];
-		char refmd5[33];
-		uint64_t refcrc;
-		char goodname[64];
-	} track;
+		/* Does this entry refer to another entry?
+		* If it does, look up the rom entry at value reference_entry. */
+		unsigned char reference : 1;
+		uint16_t reference_entry;
+	};
+};
+
+/**
+ * Growable buffer of null terminated strings, addressed by offset. Offset 0 is
+ * always the empty string.
+ */
+struct strbuf_s
+{
+	char *buf;
+	size_t len;
+	size_t alloc;
+	/* Arena of buf, or NULL if it is on the heap. */
+	struct arena_s *arena;
+};
+
+/**
+ * All entries of the ini, stored as parallel arrays indexed by entry. Sorting,
+ * de-duplication and reference resolution only touch the hot arrays at the
+ * top; the rest is only read when writing output.
+ * Each array has one spare element past the last entry.
+ */
+struct rom_table_s
+{
+	size_t entries;
+
+	uint64_t *crc;
+	union rom_conf_u *conf;
+	uint8_t (*md5)[16];
+
+	uint8_t (*refmd5)[16];
+	uint64_t *refcrc;
+	/* Offset of the good name of each entry in names. */
+	uint32_t *name;
+	struct strbuf_s names;
+	/* Index of the cheat of each entry in the cheat table. */
+	uint32_t *cheat;
+
+	/* Arena of the arrays, or NULL if they are on the heap. */
+	struct arena_s *arena;
+};
+
+/* Largest cheat index that fits in cheat_lut and cheat_lut_hi. Larger tables
+ * are indexed through a side table in the header. */
+#define CHEAT_LUT_MAX	0xFFF
+
+/**
+ * Entry using a cheat, as the offset of its good name. Users of a cheat are
+ * linked in the order they were parsed.
+ */
+struct cheat_user_s
+{
+	uint32_t name;
+	/* Next user of the same cheat, or 0 if this is the last. */
+	uint32_t next;
+};
+
+/**
+ * Cheat look-up table. Index 0 is reserved to mean that an entry has no
+ * cheat. Each cheat is stored once in text, and found through an open
+ * addressing hash of its length and bytes. The comment listing the users of a
+ * cheat is only written out when the header is dumped.
+ * A table initialised with only tot = 1 is valid and empty.
+ */
+struct cheat_table_s
+{
+	struct strbuf_s text;
+	/* Offset in text and length of each cheat. */
+	uint32_t *off;
+	uint32_t *len;
+	/* First and last user of each cheat, or 0 if none. */
+	uint32_t *first_user;
+	uint32_t *last_user;
+	size_t tot;
+	size_t alloc;
+
+	/* Element 0 is unused, so that 0 ends a list. */
+	struct cheat_user_s *users;
+	size_t nusers;
+	size_t users_alloc;
+
+	/* Cheat index of each slot, or 0 if the slot is empty. */
+	uint32_t *slots;
+	size_t mask;
+
+	/* Arena of the table, or NULL if it is on the heap. */
+	struct arena_s *arena;
+};
+
+struct ini_map_s
+{
+	const char *buf;
+	size_t len;
+};
+
+/**
+ * Map the ini file read-only into memory. The parser works directly on the
+ * mapped pages, so the buffer is not null terminated; all parsing is bounded by
+ * buf + len instead.
+ */
+static int map_file(const char *filename, struct ini_map_s *m)
+{
+	struct stat st;
+	void *p;
+	int fd = open(filename, O_RDONLY);
+
+	m->buf = NULL;
+	m->len = 0;
+
+	if(fd < 0)
+	{
+		PRINTERR();
+		return -1;
+	}
+
+	if(fstat(fd, &st) != 0)
+	{
+		PRINTERR();
+		close(fd);
+		return -1;
+	}
+
+	/* An empty file cannot be mapped, but is valid input with no
+	 * entries. */
+	if(st.st_size == 0)
+	{
+		close(fd);
+		m->buf = "";
+		return 0;
+	}
+
+	p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(p == MAP_FAILED)
+	{
+		PRINTERR();
+		return -1;
+	}
+
+	madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+	m->buf = p;
+	m->len = (size_t)st.st_size;
+	return 0;
+}
+
+static void unmap_file(struct ini_map_s *m)
+{
+	if(m->len != 0)
+		munmap((void *)m->buf, m->len);
+
+	m->buf = NULL;
+	m->len = 0;
+}
+
+/**
+ * Whether two files exist and have the same contents.
+ */
+static int same_contents(const char *a, const char *b)
+{
+	struct ini_map_s ma, mb;
+	int same;
+
+	if(access(b, R_OK) != 0 || map_file(a, &ma) != 0)
+		return 0;
+
+	if(map_file(b, &mb) != 0)
+	{
+		unmap_file(&ma);
+		return 0;
+	}
+
+	same = ma.len == mb.len && memcmp(ma.buf, mb.buf, ma.len) == 0;
+	unmap_file(&ma);
+	unmap_file(&mb);
+	return same;
+}
+
+/**
+ * Open a temporary file next to filename to write an output to. The output is
+ * moved into place by close_output().
+ */
+static FILE *open_output(const char *filename, char **tmp)
+{
+	FILE *f;
+
+	if(asprintf(tmp, "%s.tmp", filename) < 0)
+	{
+		PRINTERR();
+		*tmp = NULL;
+		return NULL;
+	}
+
+	f = fopen(*tmp, "wb");
+	if(f == NULL)
+	{
+		PRINTERR();
+		free(*tmp);
+		*tmp = NULL;
+	}
+
+	return f;
+}
+
+/**
+ * Close an output opened with open_output(), and replace filename with it.
+ * If filename already has the same contents, it is left as it is, so that its
+ * modification time does not change and dependent files are not rebuilt.
+ * Returns 0 on success, or -1 on error.
+ */
+static int close_output(FILE *f, const char *filename, char *tmp)
+{
+	int ret = 0;
+
+	if(ferror(f) | fclose(f))
+	{
+		PRINTERR();
+		ret = -1;
+	}
+	else if(same_contents(tmp, filename))
+		printf("%s is unchanged\n", filename);
+	else if(rename(tmp, filename) != 0)
+	{
+		PRINTERR();
+		ret = -1;
+	}
+	else
+	{
+		free(tmp);
+		return 0;
+	}
+
+	remove(tmp);
+	free(tmp);
+	return ret;
+}
+
+struct ini_line_s
+{
+	/* Offset of the first character of the line. */
+	uint32_t start;
+	/* Length of the line, excluding the newline. */
+	uint32_t len;
+	/* Offset of the first '=' relative to start, or len if there is
+	 * none. */
+	uint32_t eq;
+};
+
+/**
+ * Index of all non-empty, non-comment lines in the ini. Built in a single pass
+ * over the input, so that both the number of entries and the per-line
+ * dispatch in convert_entries() come from the same scan.
+ */
+struct ini_index_s
+{
+	struct ini_line_s *lines;
+	size_t nlines;
+	size_t alloc;
+
+	/* Number of lines that begin a new section with '['. */
+	size_t sections;
+
+	/* Arena of lines, or NULL if it is on the heap. */
+	struct arena_s *arena;
 };
 
-char *cheats[32] = { NULL };
-size_t cheats_tot = 1;
-char *cheats_used_by[32] = { NULL };
+static void index_push_line(struct ini_index_s *idx, const char *buf,
+		size_t start, size_t end, size_t eq)
+{
+	struct ini_line_s *l;
+
+	/* Skip empty lines and comments. */
+	if(start == end || buf[start] == ';')
+		return;
+
+	if(idx->nlines == idx->alloc)
+	{
+		const size_t old = idx->alloc * sizeof(*idx->lines);
+
+		idx->alloc = idx->alloc * 2 + 64;
+		idx->lines = mem_grow(idx->arena, idx->lines, old,
+				idx->alloc * sizeof(*idx->lines));
+	}
+
+	if(buf[start] == '[')
+		idx->sections++;
+
+	l = &idx->lines[idx->nlines++];
+	l->start = (uint32_t)start;
+	l->len = (uint32_t)(end - start);
+	l->eq = (uint32_t)((eq < end ? eq : end) - start);
+}
+
+/**
+ * Process the newline and '=' positions found within one block of the input.
+ * Bit n of each mask corresponds to byte base + n.
+ */
+static inline void scan_block(struct ini_index_s *idx, const char *buf,
+		size_t base, uint32_t m_nl, uint32_t m_eq,
+		size_t *line_start, size_t *eq)
+{
+	uint32_t m = m_nl | m_eq;
+
+	while(m != 0)
+	{
+		unsigned bit = (unsigned)__builtin_ctz(m);
+		size_t pos = base + bit;
+
+		if(m_nl & (UINT32_C(1) << bit))
+		{
+			index_push_line(idx, buf, *line_start, pos, *eq);
+			*line_start = pos + 1;
+			*eq = SIZE_MAX;
+		}
+		else if(*eq == SIZE_MAX)
+		{
+			/* Only the first '=' of a line separates key and
+			 * value. */
+			*eq = pos;
+		}
+
+		m &= m - 1;
+	}
+}
 
-static char *read_entire_file(const char *filename)
+/**
+ * Build the line index of the ini, allocated from arena if it is not NULL.
+ * Newlines and '=' separators are located with AVX2 or SSE2 compares when
+ * available, with a scalar loop for the remaining bytes.
+ */
+static void ini_scan(const char *buf, size_t len, struct ini_index_s *idx,
+		struct arena_s *arena)
 {
-	FILE *f = fopen(filename, "rb");
-	size_t fsz;
-	char *ini = NULL;
+	size_t line_start = 0;
+	size_t eq = SIZE_MAX;
+	size_t i = 0;
+
+	memset(idx, 0, sizeof(*idx));
+	idx->arena = arena;
+
+#if defined(__AVX2__)
+	{
+		const __m256i v_nl = _mm256_set1_epi8('\n');
+		const __m256i v_eq = _mm256_set1_epi8('=');
+
+		for(; i + 32 <= len; i += 32)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+			uint32_t m_nl = (uint32_t)_mm256_movemask_epi8(
+					_mm256_cmpeq_epi8(v, v_nl));
+			uint32_t m_eq = (uint32_t)_mm256_movemask_epi8(
+					_mm256_cmpeq_epi8(v, v_eq));
+
+			scan_block(idx, buf, i, m_nl, m_eq, &line_start, &eq);
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	{
+		const __m128i v_nl = _mm_set1_epi8('\n');
+		const __m128i v_eq = _mm_set1_epi8('=');
+
+		for(; i + 16 <= len; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+			uint32_t m_nl = (uint32_t)_mm_movemask_epi8(
+					_mm_cmpeq_epi8(v, v_nl));
+			uint32_t m_eq = (uint32_t)_mm_movemask_epi8(
+					_mm_cmpeq_epi8(v, v_eq));
+
+			scan_block(idx, buf, i, m_nl, m_eq, &line_start, &eq);
+		}
+	}
+#endif
+
+	for(; i < len; i++)
+	{
+		if(buf[i] == '\n')
+		{
+			index_push_line(idx, buf, line_start, i, eq);
+			line_start = i + 1;
+			eq = SIZE_MAX;
+		}
+		else if(buf[i] == '=' && eq == SIZE_MAX)
+			eq = i;
+	}
+
+	/* Last line may not be terminated by a newline. */
+	if(line_start < len)
+		index_push_line(idx, buf, line_start, len, eq);
+}
+
+static void ini_index_free(struct ini_index_s *idx)
+{
+	mem_free(idx->arena, idx->lines);
+	memset(idx, 0, sizeof(*idx));
+}
+
+/**
+ * Parse an unsigned number of the given base, skipping leading blanks. Parsing
+ * stops at the first invalid character or at eol, whichever comes first.
+ */
+static unsigned long parse_ul(const char *p, const char *eol,
+		const char **endptr, unsigned base)
+{
+	unsigned long val = 0;
+
+	while(p < eol && (*p == ' ' || *p == '\t'))
+		p++;
+
+	for(; p < eol; p++)
+	{
+		unsigned d;
+
+		if(*p >= '0' && *p <= '9')
+			d = (unsigned)(*p - '0');
+		else if(*p >= 'A' && *p <= 'F')
+			d = (unsigned)(*p - 'A' + 10);
+		else if(*p >= 'a' && *p <= 'f')
+			d = (unsigned)(*p - 'a' + 10);
+		else
+			break;
+
+		if(d >= base)
+			break;
+
+		val = val * base + d;
+	}
+
+	if(endptr != NULL)
+		*endptr = p;
+
+	return val;
+}
+
+/**
+ * Convert 32 hexadecimal characters to a binary MD5.
+ * Returns 0 on success, or -1 if str is not a valid MD5.
+ */
+static int md5_from_hex(uint8_t md5[16], const char *str, const char *eol)
+{
+	if(eol - str < 32)
+		return -1;
+
+	for(unsigned i = 0; i < 16; i++)
+	{
+		const char *endptr;
+		unsigned long b = parse_ul(str + i * 2, str + i * 2 + 2,
+				&endptr, 16);
+
+		if(endptr != str + i * 2 + 2)
+			return -1;
+
+		md5[i] = (uint8_t)b;
+	}
+
+	return 0;
+}
+
+/**
+ * Write a binary MD5 as 32 upper case hexadecimal characters and a null
+ * terminator.
+ */
+static char *md5_to_hex(char str[33], const uint8_t md5[16])
+{
+	for(unsigned i = 0; i < 16; i++)
+		sprintf(str + i * 2, "%02X", md5[i]);
+
+	return str;
+}
+
+static void strbuf_init(struct strbuf_s *sb, struct arena_s *arena)
+{
+	sb->arena = arena;
+	sb->alloc = 4096;
+	sb->buf = mem_alloc(arena, sb->alloc);
+
+	/* Offset 0 is the empty string. */
+	sb->buf[0] = '\0';
+	sb->len = 1;
+}
+
+static void strbuf_free(struct strbuf_s *sb)
+{
+	mem_free(sb->arena, sb->buf);
+	memset(sb, 0, sizeof(*sb));
+}
+
+static void strbuf_reserve(struct strbuf_s *sb, size_t len)
+{
+	const size_t old = sb->alloc;
+
+	if(sb->len + len <= sb->alloc)
+		return;
+
+	while(sb->len + len > sb->alloc)
+		sb->alloc *= 2;
+
+	sb->buf = mem_grow(sb->arena, sb->buf, old, sb->alloc);
+}
+
+/**
+ * Append a string of the given length to the buffer.
+ * Returns the offset of the new string.
+ */
+static uint32_t strbuf_add(struct strbuf_s *sb, const char *str, size_t len)
+{
+	size_t off = sb->len;
+
+	strbuf_reserve(sb, len + 1);
+	memcpy(sb->buf + off, str, len);
+	sb->buf[off + len] = '\0';
+	sb->len += len + 1;
+
+	assert(off <= UINT32_MAX);
+	return (uint32_t)off;
+}
+
+static void table_alloc(struct rom_table_s *t, size_t entries,
+		struct arena_s *arena)
+{
+	t->arena = arena;
+	t->entries = entries;
+	t->crc = mem_alloc(arena, (entries + 1) * sizeof(*t->crc));
+	t->conf = mem_alloc(arena, (entries + 1) * sizeof(*t->conf));
+	t->md5 = mem_alloc(arena, (entries + 1) * sizeof(*t->md5));
+	t->refmd5 = mem_alloc(arena, (entries + 1) * sizeof(*t->refmd5));
+	t->refcrc = mem_alloc(arena, (entries + 1) * sizeof(*t->refcrc));
+	t->name = mem_alloc(arena, (entries + 1) * sizeof(*t->name));
+	t->cheat = mem_alloc(arena, (entries + 1) * sizeof(*t->cheat));
+	strbuf_init(&t->names, arena);
+}
+
+/**
+ * Grow the arrays of the table to hold the given number of entries. New
+ * entries are zeroed, as by table_alloc().
+ */
+static void table_grow(struct rom_table_s *t, size_t entries)
+{
+	const size_t old = t->entries + 1, n = entries + 1;
+
+#define GROW(arr)							\
+	do {								\
+		t->arr = mem_grow(t->arena, t->arr,			\
+				old * sizeof(*t->arr), n * sizeof(*t->arr)); \
+		memset(t->arr + old, 0, (n - old) * sizeof(*t->arr));	\
+	} while(0)
+
+	assert(entries >= t->entries);
+	GROW(crc);
+	GROW(conf);
+	GROW(md5);
+	GROW(refmd5);
+	GROW(refcrc);
+	GROW(name);
+	GROW(cheat);
+#undef GROW
+
+	t->entries = entries;
+}
+
+static void table_free(struct rom_table_s *t)
+{
+	mem_free(t->arena, t->crc);
+	mem_free(t->arena, t->conf);
+	mem_free(t->arena, t->md5);
+	mem_free(t->arena, t->refmd5);
+	mem_free(t->arena, t->refcrc);
+	mem_free(t->arena, t->name);
+	mem_free(t->arena, t->cheat);
+	strbuf_free(&t->names);
+	memset(t, 0, sizeof(*t));
+}
+
+static const char *table_name(const struct rom_table_s *t, size_t i)
+{
+	return t->names.buf + t->name[i];
+}
+
+/**
+ * Copy entry src of the table to dst.
+ */
+static void table_move(struct rom_table_s *t, size_t dst, size_t src)
+{
+	if(dst == src)
+		return;
+
+	t->crc[dst] = t->crc[src];
+	t->conf[dst] = t->conf[src];
+	memcpy(t->md5[dst], t->md5[src], 16);
+	memcpy(t->refmd5[dst], t->refmd5[src], 16);
+	t->refcrc[dst] = t->refcrc[src];
+	t->name[dst] = t->name[src];
+	t->cheat[dst] = t->cheat[src];
+}
+
+/**
+ * Open addressing hash map from binary MD5 to entry index.
+ */
+struct md5_map_s
+{
+	struct md5_slot_s
+	{
+		uint8_t md5[16];
+		/* Index of entry, or MD5_MAP_EMPTY if the slot is unused. */
+		uint32_t index;
+	} *slots;
+	size_t mask;
+	size_t used;
+};
+
+#define MD5_MAP_EMPTY UINT32_MAX
+
+static size_t md5_hash(const uint8_t md5[16])
+{
+	uint64_t h;
+
+	/* MD5 is already uniformly distributed; mix in case of low quality
+	 * test data. */
+	memcpy(&h, md5, sizeof(h));
+	h *= UINT64_C(0x9E3779B97F4A7C15);
+	return (size_t)(h >> 32);
+}
+
+static void md5_map_init(struct md5_map_s *m, size_t entries)
+{
+	size_t cap = 16;
+
+	/* Keep the load factor at or below one half. */
+	while(cap < entries * 2)
+		cap *= 2;
+
+	m->slots = malloc(cap * sizeof(*m->slots));
+	assert(m->slots != NULL);
+	for(size_t i = 0; i < cap; i++)
+		m->slots[i].index = MD5_MAP_EMPTY;
+
+	m->mask = cap - 1;
+	m->used = 0;
+}
+
+static void md5_map_free(struct md5_map_s *m)
+{
+	free(m->slots);
+	m->slots = NULL;
+}
+
+static struct md5_slot_s *md5_map_slot(const struct md5_map_s *m,
+		const uint8_t md5[16])
+{
+	size_t i = md5_hash(md5) & m->mask;
+
+	while(m->slots[i].index != MD5_MAP_EMPTY &&
+			memcmp(m->slots[i].md5, md5, 16) != 0)
+	{
+		i = (i + 1) & m->mask;
+	}
+
+	return &m->slots[i];
+}
+
+/**
+ * Insert an MD5 into the map. If the MD5 is already present, the existing index
+ * is kept.
+ */
+static void md5_map_insert(struct md5_map_s *m, const uint8_t md5[16],
+		uint32_t index)
+{
+	struct md5_slot_s *s;
+
+	if((m->used + 1) * 2 > m->mask + 1)
+	{
+		struct md5_map_s grown;
+
+		md5_map_init(&grown, m->mask + 1);
+		for(size_t i = 0; i <= m->mask; i++)
+		{
+			if(m->slots[i].index != MD5_MAP_EMPTY)
+				*md5_map_slot(&grown, m->slots[i].md5) = m->slots[i];
+		}
+
+		grown.used = m->used;
+		md5_map_free(m);
+		*m = grown;
+	}
+
+	s = md5_map_slot(m, md5);
+	if(s->index != MD5_MAP_EMPTY)
+		return;
+
+	memcpy(s->md5, md5, 16);
+	s->index = index;
+	m->used++;
+}
+
+static uint32_t md5_map_find(const struct md5_map_s *m, const uint8_t md5[16])
+{
+	return md5_map_slot(m, md5)->index;
+}
+
+struct parse_cache_s;
+
+/**
+ * Key applied to an entry while reading a file other than the first, in the
+ * order the keys were read.
+ */
+struct prov_s
+{
+	uint32_t entry;
+	/* Index of the key in ini_keys. */
+	uint16_t key;
+	/* Index of the file in the list of inputs. */
+	uint16_t file;
+	uint32_t seq;
+};
+
+struct prov_log_s
+{
+	struct prov_s *recs;
+	size_t n;
+	size_t alloc;
+};
+
+/**
+ * State of the conversion of one shard of the ini.
+ */
+struct parser_s
+{
+	struct rom_table_s *t;
+
+	/* Entry that keys are currently applied to. */
+	size_t entry;
+
+	/* Good names read by this parser. The name offsets of its entries are
+	 * relative to this buffer until they are merged into the table. */
+	struct strbuf_s names;
+	struct cheat_table_s cheats;
+
+	/* Parse cache, or NULL if it is not used. */
+	const struct parse_cache_s *cache;
+	/* Cache records of the sections converted by this parser. */
+	struct strbuf_s recs;
+	/* Number of Cheat0 keys in the current section, and the good name
+	 * that the last one was used by. */
+	unsigned cheat_keys;
+	uint32_t cheat_name;
+	/* Number of sections converted from the cache. */
+	size_t cache_hits;
+
+	/* When reading line by line, the number of entries in the table. */
+	size_t sections;
+	/* When merging a later ini, map from MD5 to entry, the log of keys
+	 * applied and the index of the ini. */
+	struct md5_map_s *overlay;
+	struct prov_log_s *prov;
+	unsigned file;
+	/* Whether the current section is merged into an existing entry, and
+	 * whether a section was started. */
+	int merging;
+	int in_section;
+};
+
+static uint64_t cheat_hash(const char *s, size_t len)
+{
+	uint64_t h = UINT64_C(0xCBF29CE484222325);
+
+	for(size_t i = 0; i < len; i++)
+	{
+		h ^= (unsigned char)s[i];
+		h *= UINT64_C(0x100000001B3);
+	}
+
+	return h;
+}
+
+/**
+ * Returns the text of a cheat. Cheat 0 is the empty string.
+ */
+static const char *cheat_text(const struct cheat_table_s *ct, size_t ci)
+{
+	return ct->alloc == 0 ? "" : ct->text.buf + ct->off[ci];
+}
+
+/**
+ * Find a cheat given its text, which need not be null terminated.
+ * Returns the index of the cheat, or 0 if the table does not have it.
+ */
+static size_t cheat_find(const struct cheat_table_s *ct, const char *s,
+		size_t len)
+{
+	if(ct->slots == NULL)
+		return 0;
+
+	for(size_t i = cheat_hash(s, len) & ct->mask;; i = (i + 1) & ct->mask)
+	{
+		const uint32_t ci = ct->slots[i];
+
+		if(ci == 0)
+			return 0;
+
+		if(ct->len[ci] == len &&
+				memcmp(ct->text.buf + ct->off[ci], s, len) == 0)
+			return ci;
+	}
+}
+
+/**
+ * Add a cheat that the table does not have yet. The text need not be null
+ * terminated.
+ * Returns the index of the cheat.
+ */
+static size_t cheat_add(struct cheat_table_s *ct, const char *s, size_t len)
+{
+	const size_t ci = ct->tot;
+
+	if(ct->tot >= ct->alloc)
+	{
+		const size_t old = ct->alloc * sizeof(uint32_t);
+
+		if(ct->alloc == 0)
+			strbuf_init(&ct->text, ct->arena);
+
+		ct->alloc = ct->alloc == 0 ? 32 : ct->alloc * 2;
+		ct->off = mem_grow(ct->arena, ct->off, old,
+				ct->alloc * sizeof(*ct->off));
+		ct->len = mem_grow(ct->arena, ct->len, old,
+				ct->alloc * sizeof(*ct->len));
+		ct->first_user = mem_grow(ct->arena, ct->first_user, old,
+				ct->alloc * sizeof(*ct->first_user));
+		ct->last_user = mem_grow(ct->arena, ct->last_user, old,
+				ct->alloc * sizeof(*ct->last_user));
+		ct->off[0] = 0;
+		ct->len[0] = 0;
+		ct->first_user[0] = 0;
+		ct->last_user[0] = 0;
+	}
+
+	/* Keep the hash at most half full. */
+	if(2 * (ct->tot + 1) > ct->mask + 1 || ct->slots == NULL)
+	{
+		const size_t size = ct->slots == NULL ? 64 : 2 * (ct->mask + 1);
+
+		mem_free(ct->arena, ct->slots);
+		ct->slots = mem_alloc(ct->arena, size * sizeof(*ct->slots));
+		ct->mask = size - 1;
+
+		for(size_t i = 1; i < ct->tot; i++)
+		{
+			size_t h = cheat_hash(ct->text.buf + ct->off[i],
+					ct->len[i]) & ct->mask;
+
+			while(ct->slots[h] != 0)
+				h = (h + 1) & ct->mask;
+
+			ct->slots[h] = (uint32_t)i;
+		}
+	}
+
+	assert(ci < UINT32_MAX && len < UINT32_MAX);
+	ct->off[ci] = strbuf_add(&ct->text, s, len);
+	ct->len[ci] = (uint32_t)len;
+	ct->first_user[ci] = 0;
+	ct->last_user[ci] = 0;
+	ct->tot++;
+
+	for(size_t h = cheat_hash(s, len) & ct->mask;; h = (h + 1) & ct->mask)
+	{
+		if(ct->slots[h] == 0)
+		{
+			ct->slots[h] = (uint32_t)ci;
+			break;
+		}
+	}
+
+	return ci;
+}
+
+/**
+ * Append the entry with the given good name to the users of a cheat.
+ */
+static void cheat_use(struct cheat_table_s *ct, size_t ci, uint32_t name)
+{
+	const uint32_t u = ct->nusers == 0 ? 1 : (uint32_t)ct->nusers;
+
+	if(u + 1 > ct->users_alloc)
+	{
+		const size_t old = ct->users_alloc * sizeof(*ct->users);
+
+		ct->users_alloc = ct->users_alloc == 0 ?
+			64 : ct->users_alloc * 2;
+		ct->users = mem_grow(ct->arena, ct->users, old,
+				ct->users_alloc * sizeof(*ct->users));
+	}
+
+	ct->users[u].name = name;
+	ct->users[u].next = 0;
+	ct->nusers = u + 1;
+
+	if(ct->last_user[ci] == 0)
+		ct->first_user[ci] = u;
+	else
+		ct->users[ct->last_user[ci]].next = u;
+
+	ct->last_user[ci] = u;
+}
+
+/**
+ * Remove the first user of a cheat with the given good name, if there is one.
+ * Returns 0 if a user was removed, or -1 if there is none.
+ */
+static int cheat_unuse(struct cheat_table_s *ct, size_t ci, uint32_t name)
+{
+	uint32_t prev = 0;
+
+	for(uint32_t u = ct->first_user[ci]; u != 0; u = ct->users[u].next)
+	{
+		if(ct->users[u].name != name)
+		{
+			prev = u;
+			continue;
+		}
+
+		if(prev == 0)
+			ct->first_user[ci] = ct->users[u].next;
+		else
+			ct->users[prev].next = ct->users[u].next;
+
+		if(ct->last_user[ci] == u)
+			ct->last_user[ci] = prev;
+
+		return 0;
+	}
+
+	return -1;
+}
+
+/**
+ * Change the good name of the first user of a cheat with the given name, if
+ * there is one.
+ */
+static void cheat_rename(struct cheat_table_s *ct, size_t ci, uint32_t name,
+		uint32_t new_name)
+{
+	for(uint32_t u = ct->first_user[ci]; u != 0; u = ct->users[u].next)
+	{
+		if(ct->users[u].name == name)
+		{
+			ct->users[u].name = new_name;
+			return;
+		}
+	}
+}
+
+static void key_crc(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	uint32_t c1, c2 = 0;
+	const char *endptr;
+
+	c1 = (uint32_t)parse_ul(val, endline, &endptr, 16);
+
+	/* Move to second CRC. The line may end at the end of the mapping, so
+	 * endptr must be checked against endline before it is read. */
+	if(endptr < endline && *endptr == ' ')
+		c2 = (uint32_t)parse_ul(endptr, endline, &endptr, 16);
+	else
+		endptr = NULL;
+
+	if(endptr != endline)
+	{
+		fprintf(stderr, "WARNING: Invalid CRC '%.*s'\n",
+				(int)(endline - val), val);
+	}
+	else
+		p->t->crc[p->entry] = ((uint64_t)c1 << 32) | c2;
+
+	/* Only the CRC is replaced when merging into an existing entry. */
+	if(p->merging)
+		return;
+
+	/* Init variables to default values. */
+	conf->status = 0;
+	conf->save_type = 5;
+	conf->players = 4;
+	conf->rumble = 1;
+	conf->transferpak = 0;
+	conf->mempak = 1;
+	conf->biopak = 0;
+	conf->count_per_op = 2;
+	conf->disable_extra_mem = 0;
+	conf->si_dma_duration = 0;
+	conf->ai_dma_modifier = 0;
+}
+
+static void key_refmd5(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+
+	if(md5_from_hex(p->t->refmd5[p->entry], val, endline) != 0)
+	{
+		fprintf(stderr, "WARNING: Invalid RefMD5 '%.*s'\n",
+				(int)(endline - val), val);
+		return;
+	}
+
+	conf->reference = 1;
+}
+
+static void key_savetype(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	assert(val < endline);
+
+	switch(*val)
+	{
+	case 'E':
+		assert(endline - val > (ptrdiff_t)strlen("Eeprom "));
+		if(*(val + strlen("Eeprom ")) == '4')
+			conf->save_type = SAVE_EEPROM_4KB;
+		else if(*(val + strlen("Eeprom ")) == '1')
+			conf->save_type = SAVE_EEPROM_16KB;
+		else
+			abort();
+		break;
+	case 'S':
+		conf->save_type = SAVE_SRAM;
+		break;
+
+	case 'F':
+		conf->save_type = SAVE_FLASH_RAM;
+		break;
+
+	case 'C':
+		conf->save_type = SAVE_CONTROLLER_PACK;
+		break;
+
+	case 'N':
+		conf->save_type = SAVE_NONE;
+		break;
+
+	default:
+		abort();
+	}
+}
+
+static void key_status(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	const char *endptr;
+	unsigned status;
+
+	status = (unsigned)parse_ul(val, endline, &endptr, 10);
+	assert(endptr == endline);
+	assert(status < 6);
+	conf->status = status & 0x7;
+}
+
+static void key_players(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	const char *endptr;
+	unsigned players;
+
+	players = (unsigned)parse_ul(val, endline, &endptr, 10);
+	assert(endptr == endline);
+	assert(players < 8);
+	conf->players = players & 0x7;
+}
+
+static void key_rumble(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	conf->rumble = (val < endline && *val == 'Y');
+}
+
+static void key_countperop(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	const char *endptr;
+	unsigned count_per_op;
+
+	count_per_op = (unsigned)parse_ul(val, endline, &endptr, 10);
+	assert(endptr == endline);
+	assert(count_per_op <= 4);
+	conf->count_per_op = count_per_op & 0x7;
+}
+
+static void key_disableextramem(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	conf->count_per_op = (val < endline && *val == '1');
+}
+
+/**
+ * Set the cheat of the current entry, listing the entry with the given good
+ * name as a user of the cheat.
+ */
+static void use_cheat(struct parser_s *p, const char *val, size_t len,
+		uint32_t name)
+{
+	struct cheat_table_s *ct = &p->cheats;
+	const char *goodname = p->names.buf + name;
+	size_t cheat_found;
+
+	cheat_found = cheat_find(ct, val, len);
+	if(cheat_found)
+	{
+		cheat_use(ct, cheat_found, name);
+		p->t->cheat[p->entry] = (uint32_t)cheat_found;
+		fprintf(stderr, "DEBUG: Cheat for %s found in"
+				" entry %zu\n",
+				goodname,
+				cheat_found);
+		return;
+	}
+
+	cheat_found = cheat_add(ct, val, len);
+	cheat_use(ct, cheat_found, name);
+	p->t->cheat[p->entry] = (uint32_t)cheat_found;
+
+	fprintf(stderr, "DEBUG: Cheat %zu added for %s\n",
+			cheat_found, goodname);
+}
+
+static void key_cheat0(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	const uint32_t name = p->t->name[p->entry];
+
+	/* A cheat that is replaced is no longer used by the entry. It is used
+	 * without a name if Cheat0 came before GoodName in its section. */
+	if(p->merging && p->t->cheat[p->entry] != 0 &&
+			cheat_unuse(&p->cheats, p->t->cheat[p->entry],
+				name) != 0)
+		cheat_unuse(&p->cheats, p->t->cheat[p->entry], 0);
+
+	p->cheat_keys++;
+	p->cheat_name = name;
+	use_cheat(p, val, (size_t)(endline - val), name);
+}
+
+static void key_transferpak(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	conf->transferpak = (val < endline && *val == 'Y');
+}
+
+static void key_mempak(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	conf->biopak = (val < endline && *val == 'Y');
+}
+
+static void key_biopak(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	conf->biopak = (val < endline && *val == 'Y');
+}
+
+static void key_sidmaduration(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	assert(val < endline && *val == '1');
+	conf->si_dma_duration = 1;
+}
+
+static void key_aidmamodifier(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	union rom_conf_u *conf = &p->t->conf[p->entry];
+	unsigned dma_mod;
+
+	dma_mod = (unsigned)parse_ul(val, endline, NULL, 10);
+	if(dma_mod == 88)
+		conf->ai_dma_modifier = 1;
+	else
+	{
+		fprintf(stderr, "WARNING: AiDmaModifier of %ul "
+				"is not supported\n",
+				dma_mod);
+	}
+}
+
+static void key_goodname(struct parser_s *p, const char *val,
+		const char *endline)
+{
+	uint32_t name;
+	size_t len;
+
+	len = endline - val;
+	if(len >= 64)
+		len = 63;
+
+	name = strbuf_add(&p->names, val, len);
+
+	/* The cheat of a merged entry stays used under its current name, so
+	 * that it is found if the cheat is replaced. */
+	if(p->merging && p->t->cheat[p->entry] != 0)
+	{
+		cheat_rename(&p->cheats, p->t->cheat[p->entry],
+				p->t->name[p->entry], name);
+	}
+
+	p->t->name[p->entry] = name;
+}
+
+struct ini_key_s
+{
+	const char *name;
+	size_t len;
+	void (*handler)(struct parser_s *p, const char *val,
+			const char *endline);
+};
+
+/**
+ * Perfect hash over the known keys, using the first and last character and the
+ * length of the key. The characters are passed to KEY() separately as string
+ * subscripts are not constant expressions. A collision between two keys in
+ * ini_keys is reported at compile time by -Woverride-init.
+ */
+#define KEY_HASH(first, last, len)					\
+	(((unsigned)(unsigned char)(first) +				\
+	  (unsigned)(unsigned char)(last) + 2u * (unsigned)(len)) & 31u)
+#define KEY(str, first, last, fn)					\
+	[KEY_HASH(first, last, sizeof(str) - 1)] = { str, sizeof(str) - 1, fn }
+
+static const struct ini_key_s ini_keys[32] = {
+	KEY("CRC", 'C', 'C', key_crc),
+	KEY("RefMD5", 'R', '5', key_refmd5),
+	KEY("SaveType", 'S', 'e', key_savetype),
+	KEY("Status", 'S', 's', key_status),
+	KEY("Players", 'P', 's', key_players),
+	KEY("Rumble", 'R', 'e', key_rumble),
+	KEY("CountPerOp", 'C', 'p', key_countperop),
+	KEY("DisableExtraMem", 'D', 'm', key_disableextramem),
+	KEY("Cheat0", 'C', '0', key_cheat0),
+	KEY("Transferpak", 'T', 'k', key_transferpak),
+	KEY("Mempak", 'M', 'k', key_mempak),
+	KEY("Biopak", 'B', 'k', key_biopak),
+	KEY("SiDmaDuration", 'S', 'n', key_sidmaduration),
+	KEY("AiDmaModifier", 'A', 'r', key_aidmamodifier),
+	KEY("GoodName", 'G', 'e', key_goodname)
+};
+#undef KEY
+
+static const struct ini_key_s *lookup_key(const char *key, size_t len)
+{
+	const struct ini_key_s *k;
+
+	if(len == 0)
+		return NULL;
+
+	k = &ini_keys[KEY_HASH(key[0], key[len - 1], len)];
+	if(k->len != len || memcmp(k->name, key, len) != 0)
+		return NULL;
+
+	return k;
+}
+
+static void free_cheats(struct cheat_table_s *ct)
+{
+	if(ct->alloc != 0)
+		strbuf_free(&ct->text);
+
+	mem_free(ct->arena, ct->off);
+	mem_free(ct->arena, ct->len);
+	mem_free(ct->arena, ct->first_user);
+	mem_free(ct->arena, ct->last_user);
+	mem_free(ct->arena, ct->users);
+	mem_free(ct->arena, ct->slots);
+	memset(ct, 0, sizeof(*ct));
+	ct->tot = 1;
+}
+
+/**
+ * Append the cheats of src to dst, merging cheats that dst already has, and
+ * renumber the cheat index of the given entries from src to dst indexes. The
+ * names of the users of src are offset by name_base, as they are moved to the
+ * table by merge_names(). src is left empty.
+ */
+static void merge_cheats(struct cheat_table_s *dst, struct cheat_table_s *src,
+		uint32_t *cheat, size_t entries, size_t name_base)
+{
+	uint32_t *remap = mem_alloc(dst->arena, src->tot * sizeof(*remap));
+
+	for(size_t si = 1; si < src->tot; si++)
+	{
+		const char *text = cheat_text(src, si);
+		size_t di = cheat_find(dst, text, src->len[si]);
+
+		if(di == 0)
+			di = cheat_add(dst, text, src->len[si]);
+
+		for(uint32_t u = src->first_user[si]; u != 0;
+				u = src->users[u].next)
+		{
+			const uint32_t name = src->users[u].name;
+
+			cheat_use(dst, di, name == 0 ?
+					0 : (uint32_t)(name + name_base));
+		}
+
+		remap[si] = (uint32_t)di;
+	}
+
+	for(size_t i = 0; i < entries; i++)
+		cheat[i] = remap[cheat[i]];
+
+	mem_free(dst->arena, remap);
+	free_cheats(src);
+}
+
+/**
+ * Move the good names of the entries [first, first + entries) from the buffer
+ * of their parser into the table.
+ */
+static void merge_names(struct rom_table_s *t, const struct strbuf_s *names,
+		size_t first, size_t entries)
+{
+	/* Offset 0 of both buffers is the shared empty string. */
+	size_t base = t->names.len - 1;
+
+	strbuf_reserve(&t->names, names->len - 1);
+	memcpy(t->names.buf + t->names.len, names->buf + 1, names->len - 1);
+	t->names.len += names->len - 1;
+
+	for(size_t i = first; i < first + entries; i++)
+	{
+		if(t->name[i] != 0)
+			t->name[i] = (uint32_t)(t->name[i] + base);
+	}
+}
+
+/**
+ * Hash of a string, continuing from h. This is only used to detect changes to
+ * the ini, so it favours speed over strength; the MD5 of a section is checked
+ * as well before its cache record is used.
+ */
+static uint64_t hash_bytes(uint64_t h, const char *s, size_t len)
+{
+	const uint64_t k = UINT64_C(0x9E3779B97F4A7C15);
+	uint64_t w;
+
+	h = (h ^ len) * k;
+	for(; len >= sizeof(w); s += sizeof(w), len -= sizeof(w))
+	{
+		memcpy(&w, s, sizeof(w));
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+
+	w = 0;
+	memcpy(&w, s, len);
+	h = (h ^ w) * k;
+	return h ^ (h >> 29);
+}
+
+/**
+ * Hash all lines of the ini, continuing from h. Empty lines and comments are
+ * not part of the index, so do not change the hash.
+ */
+static uint64_t hash_lines(uint64_t h, const char *ini,
+		const struct ini_index_s *idx)
+{
+	for(size_t li = 0; li < idx->nlines; li++)
+	{
+		h = hash_bytes(h, ini + idx->lines[li].start,
+				idx->lines[li].len);
+	}
+
+	return h;
+}
+
+#define CACHE_MAGIC	"M64CACHE"
+/* Must be increased whenever the records, or the output written from the same
+ * input and options, change. */
+#define CACHE_VERSION	2
+/* Outputs whose contents are recorded in the cache: the header, the binary
+ * database and the provenance. */
+#define CACHE_OUTPUTS	3
+
+/* Flags of a cache record. */
+#define CACHE_NAMED		0x1
+#define CACHE_CHEAT		0x2
+#define CACHE_CHEAT_NAMED	0x4
+
+/**
+ * Parsed section of the ini, followed by name_len bytes of good name and
+ * cheat_len bytes of cheat. Records are stored unaligned.
+ */
+struct cache_rec_s
+{
+	/* Hash of the lines of the section. */
+	uint64_t hash;
+	uint64_t crc;
+	uint8_t md5[16];
+	uint8_t refmd5[16];
+	union rom_conf_u conf;
+	uint32_t name_len;
+	uint32_t cheat_len;
+	uint32_t flags;
+};
+
+/**
+ * Header of the cache file, followed by the records of all sections that could
+ * be cached. The cache is only meant to be read on the machine that wrote it,
+ * so values are stored in host order.
+ */
+struct cache_hdr_s
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;
+	uint64_t recs_len;
+	/* Hash of the ini and the options that affect the output. */
+	uint64_t digest;
+	/* Hash of each of the outputs that were written, or 0 if the output
+	 * was not written. */
+	uint64_t out_hash[CACHE_OUTPUTS];
+};
+
+/**
+ * Cache of parsed sections, keyed by the hash of their lines. Sections that
+ * are unchanged since the cache was written are copied from their record
+ * instead of being parsed again.
+ */
+struct parse_cache_s
+{
+	/* Cache file read at start, or empty. */
+	struct ini_map_s old;
+	struct cache_hdr_s old_hdr;
+	/* Offset in old.buf of the record in each slot, or 0 if empty. */
+	size_t *slots;
+	size_t mask;
+
+	/* Hash of each section of the ini. */
+	uint64_t *hash;
+	uint64_t digest;
+	/* Records of this run, in section order. */
+	struct strbuf_s recs;
+	size_t hits;
+};
+
+/**
+ * Hash the options and all lines of the ini, and each of its sections.
+ */
+static void cache_hash_ini(struct parse_cache_s *pc, const char *ini,
+		const struct ini_index_s *idx, uint64_t options)
+{
+	uint64_t h = options;
+	size_t sec = 0;
+
+	pc->hash = calloc(idx->sections + 1, sizeof(*pc->hash));
+	assert(pc->hash != NULL);
+
+	for(size_t li = 0; li < idx->nlines; li++)
+	{
+		const char *line = ini + idx->lines[li].start;
+		const size_t len = idx->lines[li].len;
+
+		if(*line == '[')
+		{
+			pc->hash[sec++] = hash_bytes(0, line, len);
+			continue;
+		}
+
+		/* Lines before the first section are only part of the
+		 * digest. */
+		if(sec == 0)
+			h = hash_bytes(h, line, len);
+		else
+			pc->hash[sec - 1] = hash_bytes(pc->hash[sec - 1],
+					line, len);
+	}
+
+	for(size_t i = 0; i < sec; i++)
+		h = hash_bytes(h, (const char *)&pc->hash[i],
+				sizeof(pc->hash[i]));
+
+	pc->digest = h;
+}
+
+/**
+ * Read the cache file, if there is one and it is valid.
+ */
+static void cache_load(struct parse_cache_s *pc, const char *filename)
+{
+	size_t off, n = 0;
+
+	memset(pc, 0, sizeof(*pc));
+	strbuf_init(&pc->recs, NULL);
+
+	if(access(filename, F_OK) != 0 || map_file(filename, &pc->old) != 0)
+		return;
+
+	if(pc->old.len < sizeof(pc->old_hdr))
+		goto invalid;
+
+	memcpy(&pc->old_hdr, pc->old.buf, sizeof(pc->old_hdr));
+	if(memcmp(pc->old_hdr.magic, CACHE_MAGIC, 8) != 0 ||
+			pc->old_hdr.version != CACHE_VERSION ||
+			pc->old_hdr.rec_size != sizeof(struct cache_rec_s) ||
+			pc->old_hdr.recs_len !=
+			pc->old.len - sizeof(pc->old_hdr))
+		goto invalid;
+
+	/* Check the bounds of all records before using any. */
+	for(off = sizeof(pc->old_hdr); off < pc->old.len; n++)
+	{
+		struct cache_rec_s r;
+
+		if(pc->old.len - off < sizeof(r))
+			goto invalid;
+
+		memcpy(&r, pc->old.buf + off, sizeof(r));
+		off += sizeof(r);
+		if(r.name_len > pc->old.len - off ||
+				r.cheat_len > pc->old.len - off - r.name_len)
+			goto invalid;
+
+		off += r.name_len + r.cheat_len;
+	}
+
+	/* Keep the hash at most half full. */
+	pc->mask = 15;
+	while(pc->mask + 1 < 2 * n)
+		pc->mask = pc->mask * 2 + 1;
+
+	pc->slots = calloc(pc->mask + 1, sizeof(*pc->slots));
+	assert(pc->slots != NULL);
+
+	for(off = sizeof(pc->old_hdr); off < pc->old.len;)
+	{
+		struct cache_rec_s r;
+		size_t i;
+
+		memcpy(&r, pc->old.buf + off, sizeof(r));
+		for(i = r.hash & pc->mask; pc->slots[i] != 0;
+				i = (i + 1) & pc->mask)
+			;
+
+		pc->slots[i] = off;
+		off += sizeof(r) + r.name_len + r.cheat_len;
+	}
+
+	return;
+
+invalid:
+	fprintf(stderr, "WARNING: Ignoring invalid cache %s\n", filename);
+	unmap_file(&pc->old);
+	memset(&pc->old_hdr, 0, sizeof(pc->old_hdr));
+}
+
+/**
+ * Hash the lines of a later ini onto the digest of the cache.
+ * Returns 0 on success, or -1 if the file cannot be mapped, such as a pipe.
+ */
+static int cache_hash_overlay(struct parse_cache_s *pc, const char *filename)
+{
+	struct ini_map_s ini;
+	struct ini_index_s idx;
+	struct stat st;
+
+	if(stat(filename, &st) != 0 || !S_ISREG(st.st_mode) ||
+			map_file(filename, &ini) != 0)
+		return -1;
+
+	ini_scan(ini.buf, ini.len, &idx, NULL);
+	pc->digest = hash_lines(pc->digest, ini.buf, &idx);
+	ini_index_free(&idx);
+	unmap_file(&ini);
+	return 0;
+}
+
+/**
+ * Find the record of a section given the hash of its lines and its MD5.
+ * Returns the offset of the record in the cache file, or 0 if there is none.
+ */
+static size_t cache_find(const struct parse_cache_s *pc, uint64_t hash,
+		const uint8_t md5[16], struct cache_rec_s *r)
+{
+	if(pc->slots == NULL)
+		return 0;
+
+	for(size_t i = hash & pc->mask; pc->slots[i] != 0;
+			i = (i + 1) & pc->mask)
+	{
+		memcpy(r, pc->old.buf + pc->slots[i], sizeof(*r));
+		if(r->hash == hash && memcmp(r->md5, md5, 16) == 0)
+			return pc->slots[i];
+	}
+
+	return 0;
+}
+
+/**
+ * Convert the current section from its record, as if its lines were parsed.
+ * The MD5 of the entry is already set.
+ */
+static void cache_replay(struct parser_s *p, const struct cache_rec_s *r,
+		const char *text)
+{
+	struct rom_table_s *t = p->t;
+	const size_t e = p->entry;
+
+	t->crc[e] = r->crc;
+	t->conf[e] = r->conf;
+	memcpy(t->refmd5[e], r->refmd5, 16);
+
+	if(r->flags & CACHE_NAMED)
+		t->name[e] = strbuf_add(&p->names, text, r->name_len);
+
+	if(r->flags & CACHE_CHEAT)
+	{
+		use_cheat(p, text + r->name_len, r->cheat_len,
+				(r->flags & CACHE_CHEAT_NAMED) ? t->name[e] : 0);
+	}
+}
+
+/**
+ * Append the record of the current section at off in the old cache file, which
+ * it was replayed from, to the records of the parser, so that it is kept when
+ * the cache is saved.
+ */
+static void cache_keep(struct parser_s *p, const struct cache_rec_s *r,
+		size_t off)
+{
+	const size_t len = sizeof(*r) + r->name_len + r->cheat_len;
+
+	strbuf_reserve(&p->recs, len);
+	memcpy(p->recs.buf + p->recs.len, p->cache->old.buf + off, len);
+	p->recs.len += len;
+}
+
+/**
+ * Append a record of the current section, which was just parsed, to the
+ * records of the parser. Sections that cannot be replayed from a record, as
+ * they set the cheat more than once or before the last good name, are left out.
+ */
+static void cache_store(struct parser_s *p)
+{
+	const struct rom_table_s *t = p->t;
+	const size_t e = p->entry;
+	const char *name = p->names.buf + t->name[e];
+	const char *cheat = cheat_text(&p->cheats, t->cheat[e]);
+	struct cache_rec_s r;
+
+	if(p->cheat_keys > 1 || (p->cheat_keys == 1 && p->cheat_name != 0 &&
+				p->cheat_name != t->name[e]))
+		return;
+
+	memset(&r, 0, sizeof(r));
+	r.hash = p->cache->hash[e];
+	r.crc = t->crc[e];
+	memcpy(r.md5, t->md5[e], 16);
+	memcpy(r.refmd5, t->refmd5[e], 16);
+	r.conf = t->conf[e];
+	if(t->name[e] != 0)
+	{
+		r.flags |= CACHE_NAMED;
+		r.name_len = (uint32_t)strlen(name);
+	}
+	if(p->cheat_keys == 1)
+	{
+		r.flags |= CACHE_CHEAT;
+		r.cheat_len = p->cheats.len[t->cheat[e]];
+		if(p->cheat_name != 0)
+			r.flags |= CACHE_CHEAT_NAMED;
+	}
+
+	strbuf_reserve(&p->recs, sizeof(r) + r.name_len + r.cheat_len);
+	memcpy(p->recs.buf + p->recs.len, &r, sizeof(r));
+	memcpy(p->recs.buf + p->recs.len + sizeof(r), name, r.name_len);
+	memcpy(p->recs.buf + p->recs.len + sizeof(r) + r.name_len, cheat,
+			r.cheat_len);
+	p->recs.len += sizeof(r) + r.name_len + r.cheat_len;
+}
+
+/**
+ * Hash the contents of a file.
+ * Returns 0 if the file does not exist or cannot be read.
+ */
+static uint64_t cache_hash_file(const char *filename)
+{
+	struct ini_map_s m;
+	uint64_t h;
+
+	if(filename == NULL || access(filename, R_OK) != 0 ||
+			map_file(filename, &m) != 0)
+		return 0;
+
+	h = hash_bytes(1, m.buf, m.len);
+	unmap_file(&m);
+	return h;
+}
+
+/**
+ * Add the outputs, which are NULL if not asked for, and the stamp to the
+ * digest, so that asking for another output or stamp is not up to date.
+ */
+static void cache_hash_outputs(struct parse_cache_s *pc,
+		const char *const outputs[CACHE_OUTPUTS], const char *epoch)
+{
+	for(unsigned i = 0; i < CACHE_OUTPUTS; i++)
+	{
+		const char *s = outputs[i] != NULL ? outputs[i] : "";
+
+		/* The terminator tells no output from an empty name. */
+		pc->digest = hash_bytes(pc->digest, s,
+				strlen(s) + (outputs[i] != NULL));
+	}
+
+	if(epoch != NULL)
+		pc->digest = hash_bytes(pc->digest, epoch, strlen(epoch) + 1);
+}
+
+/**
+ * Whether the outputs written when the cache was saved are still in place, and
+ * the ini and options are unchanged since. An output that is asked for but
+ * does not exist is never up to date.
+ */
+static int cache_up_to_date(const struct parse_cache_s *pc,
+		const char *const outputs[CACHE_OUTPUTS])
+{
+	if(pc->old.len == 0 || pc->old_hdr.digest != pc->digest)
+		return 0;
+
+	for(unsigned i = 0; i < CACHE_OUTPUTS; i++)
+	{
+		uint64_t h = cache_hash_file(outputs[i]);
+
+		if((outputs[i] != NULL && h == 0) ||
+				pc->old_hdr.out_hash[i] != h)
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Write the records of this run to the cache file, with the hashes of the
+ * outputs that were written.
+ */
+static void cache_save(const struct parse_cache_s *pc, const char *filename,
+		const char *const outputs[CACHE_OUTPUTS])
+{
+	struct cache_hdr_s hdr;
+	char *tmp;
+	FILE *f;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CACHE_MAGIC, 8);
+	hdr.version = CACHE_VERSION;
+	hdr.rec_size = sizeof(struct cache_rec_s);
+	/* Offset 0 of the records is the empty string of the buffer. */
+	hdr.recs_len = pc->recs.len - 1;
+	hdr.digest = pc->digest;
+	for(unsigned i = 0; i < CACHE_OUTPUTS; i++)
+		hdr.out_hash[i] = cache_hash_file(outputs[i]);
+
+	f = open_output(filename, &tmp);
+	if(f == NULL)
+		return;
+
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	fwrite(pc->recs.buf + 1, 1, pc->recs.len - 1, f);
+	close_output(f, filename, tmp);
+}
+
+static void cache_free(struct parse_cache_s *pc)
+{
+	unmap_file(&pc->old);
+	free(pc->slots);
+	free(pc->hash);
+	strbuf_free(&pc->recs);
+	memset(pc, 0, sizeof(*pc));
+}
+
+/**
+ * Start converting the section in the given line to the entry p->entry.
+ */
+static void start_section(struct parser_s *p, const char *line,
+		const char *endline)
+{
+	line++;
+	if(md5_from_hex(p->t->md5[p->entry], line, endline) != 0)
+	{
+		fprintf(stderr, "WARNING: Invalid MD5 '%.*s'\n",
+				(int)(endline - line), line);
+	}
+
+	p->cheat_keys = 0;
+	p->cheat_name = 0;
+}
+
+/**
+ * Apply a key of the current section, where eq is the offset of the first '='
+ * in the line, or the length of the line if there is none.
+ */
+static void apply_key(struct parser_s *p, const char *line,
+		const char *endline, size_t eq)
+{
+	/* Keys are only recognised if followed by a value. */
+	const struct ini_key_s *k = line + eq < endline ?
+		lookup_key(line, eq) : NULL;
+
+	if(k == NULL)
+	{
+		int len = (int)(endline - line);
+		fprintf(stderr, "WARNING: Unknown key '%.*s'\n", len, line);
+		return;
+	}
+
+	k->handler(p, line + eq + 1, endline);
+
+	if(p->prov != NULL)
+	{
+		struct prov_log_s *log = p->prov;
+
+		if(log->n == log->alloc)
+		{
+			log->alloc = log->alloc == 0 ? 64 : log->alloc * 2;
+			log->recs = realloc(log->recs,
+					log->alloc * sizeof(*log->recs));
+			assert(log->recs != NULL);
+		}
+
+		assert(log->n < UINT32_MAX);
+		log->recs[log->n].entry = (uint32_t)p->entry;
+		log->recs[log->n].key = (uint16_t)(k - ini_keys);
+		log->recs[log->n].file = (uint16_t)p->file;
+		log->recs[log->n].seq = (uint32_t)log->n;
+		log->n++;
+	}
+}
+
+/**
+ * Convert the lines [first_line, last_line) of the ini into entries starting at
+ * p->entry. The first line must either be the first line of the ini or start a
+ * section.
+ */
+static void convert_lines(const char *ini, const struct ini_index_s *idx,
+		size_t first_line, size_t last_line, struct parser_s *p)
+{
+	int first = 1;
+	/* Whether the lines of the current section are parsed, and whether
+	 * keys were applied to the entry before its section started. */
+	int parsed = 0, dirty = 0;
+
+	for(size_t li = first_line; li < last_line; li++)
+	{
+		const struct ini_line_s *l = &idx->lines[li];
+		const char *line = ini + l->start;
+		const char *endline = line + l->len;
+
+		if(*line == '[')
+		{
+			struct cache_rec_s r;
+			size_t off;
+
+			/* New entry. */
+			/* Compensate for 0-based indexing. */
+			if(first)
+				first = 0;
+			else
+			{
+				if(parsed && p->cache != NULL)
+					cache_store(p);
+
+				/* Set to new entry. */
+				p->entry++;
+			}
+
+			start_section(p, line, endline);
+
+			/* A section with keys before it is neither replayed
+			 * nor stored. */
+			parsed = !dirty;
+			if(p->cache == NULL || dirty)
+			{
+				dirty = 0;
+				continue;
+			}
+
+			off = cache_find(p->cache, p->cache->hash[p->entry],
+					p->t->md5[p->entry], &r);
+			if(off == 0)
+				continue;
+
+			/* Skip the lines of the section. */
+			cache_replay(p, &r, p->cache->old.buf + off + sizeof(r));
+			cache_keep(p, &r, off);
+			while(li + 1 < last_line &&
+					ini[idx->lines[li + 1].start] != '[')
+				li++;
+
+			p->cache_hits++;
+			parsed = 0;
+			continue;
+		}
+
+		if(first)
+			dirty = 1;
+
+		apply_key(p, line, endline, l->eq);
+	}
+
+	if(parsed && p->cache != NULL)
+		cache_store(p);
+}
+
+struct shard_s
+{
+	/* Arena of the names and cheats of the parser. */
+	struct arena_s arena;
+
+	const char *ini;
+	const struct ini_index_s *idx;
+	size_t first_line;
+	size_t last_line;
+
+	/* First entry of this shard, and number of entries. */
+	size_t first;
+	size_t entries;
+
+	struct parser_s p;
+	pthread_t thread;
+	/* Whether the shard is converted on its own thread. */
+	int threaded;
+};
+
+static void *shard_thread(void *arg)
+{
+	struct shard_s *sh = arg;
+
+	convert_lines(sh->ini, sh->idx, sh->first_line, sh->last_line, &sh->p);
+	return NULL;
+}
+
+/**
+ * Convert all entries of the ini into the table. If jobs is greater than one,
+ * the sections are split into that many shards which are converted in
+ * parallel. The shards are then merged in order, so that the result is
+ * identical to a sequential conversion.
+ * If arena is not NULL, the table is allocated from it, and each shard uses an
+ * arena of its own that is freed once the shard is merged.
+ * If cache is not NULL, unchanged sections are converted from it, and the
+ * records of all sections are appended to it.
+ */
+void convert_entries(const char *ini, const struct ini_index_s *idx,
+		unsigned jobs, struct rom_table_s *t, struct cheat_table_s *ct,
+		struct arena_s *arena, struct parse_cache_s *cache)
+{
+	const size_t entries = idx->sections;
+	struct shard_s *sh;
+	size_t section = 0;
+	unsigned s = 1;
+
+	table_alloc(t, entries, arena);
+
+	if(jobs > entries)
+		jobs = (unsigned)entries;
+	if(jobs == 0)
+		jobs = 1;
+
+	sh = mem_alloc(arena, jobs * sizeof(*sh));
+
+	/* Split at section boundaries, so that each shard has an equal number
+	 * of entries. Any lines before the first section go to the first
+	 * shard. */
+	sh[0].first_line = 0;
+	sh[0].first = 0;
+	for(size_t li = 0; li < idx->nlines && s < jobs; li++)
+	{
+		if(ini[idx->lines[li].start] != '[')
+			continue;
+
+		if(section == s * entries / jobs)
+		{
+			sh[s].first_line = li;
+			sh[s].first = section;
+			sh[s - 1].last_line = li;
+			sh[s - 1].entries = section - sh[s - 1].first;
+			s++;
+		}
+
+		section++;
+	}
+	sh[jobs - 1].last_line = idx->nlines;
+	sh[jobs - 1].entries = entries - sh[jobs - 1].first;
+
+	for(unsigned i = 0; i < jobs; i++)
+	{
+		sh[i].ini = ini;
+		sh[i].idx = idx;
+		sh[i].p.t = t;
+		sh[i].p.entry = sh[i].first;
+		sh[i].p.cheats.tot = 1;
+		sh[i].p.cheats.arena = arena != NULL ? &sh[i].arena : NULL;
+		strbuf_init(&sh[i].p.names, sh[i].p.cheats.arena);
+		sh[i].p.cache = cache;
+		if(cache != NULL)
+			strbuf_init(&sh[i].p.recs, NULL);
+
+		/* Only start threads when there is more than one shard. A
+		 * shard whose thread cannot be started is converted here. */
+		sh[i].threaded = jobs > 1 && pthread_create(&sh[i].thread,
+				NULL, shard_thread, &sh[i]) == 0;
+		if(!sh[i].threaded)
+			shard_thread(&sh[i]);
+	}
+
+	for(unsigned i = 0; i < jobs; i++)
+	{
+		if(sh[i].threaded)
+			pthread_join(sh[i].thread, NULL);
+
+		merge_cheats(ct, &sh[i].p.cheats, t->cheat + sh[i].first,
+				sh[i].entries, t->names.len - 1);
+		merge_names(t, &sh[i].p.names, sh[i].first, sh[i].entries);
+		strbuf_free(&sh[i].p.names);
+
+		if(cache != NULL)
+		{
+			/* Offset 0 of both buffers is the empty string. */
+			strbuf_reserve(&cache->recs, sh[i].p.recs.len - 1);
+			memcpy(cache->recs.buf + cache->recs.len,
+					sh[i].p.recs.buf + 1,
+					sh[i].p.recs.len - 1);
+			cache->recs.len += sh[i].p.recs.len - 1;
+			cache->hits += sh[i].p.cache_hits;
+			strbuf_free(&sh[i].p.recs);
+		}
+
+		if(arena != NULL)
+			arena_free(&sh[i].arena);
+	}
+
+	mem_free(arena, sh);
+}
+
+/* Size of the ring buffer used to read a stream, which is also the longest
+ * line that can be read. */
+#define STREAM_BUF_SIZE	(64 * 1024)
+
+/**
+ * Reader of lines from a file descriptor that cannot be mapped, such as a pipe.
+ * Input is read into a ring buffer of fixed size, so memory use does not depend
+ * on the size of the input.
+ */
+struct stream_s
+{
+	int fd;
+	int eof;
+
+	/* Unread input is [head, head + used) modulo STREAM_BUF_SIZE, of
+	 * which the first scanned bytes are known not to hold a newline. */
+	char *ring;
+	size_t head;
+	size_t used;
+	size_t scanned;
+
+	/* A line that wraps around the end of the ring is copied here. */
+	char *line;
+};
+
+/**
+ * Read more input into the free space of the ring.
+ * Returns 0 on success, or -1 on error.
+ */
+static int stream_fill(struct stream_s *st)
+{
+	size_t tail, space;
+	ssize_t n;
+
+	/* Read into the whole ring when it is empty. */
+	if(st->used == 0)
+		st->head = 0;
+
+	tail = (st->head + st->used) % STREAM_BUF_SIZE;
+	space = tail >= st->head && st->used != STREAM_BUF_SIZE ?
+		STREAM_BUF_SIZE - tail : st->head - tail;
+	assert(space != 0);
+
+	do
+		n = read(st->fd, st->ring + tail, space);
+	while(n < 0 && errno == EINTR);
+
+	if(n < 0)
+	{
+		PRINTERR();
+		return -1;
+	}
+
+	if(n == 0)
+		st->eof = 1;
+
+	st->used += (size_t)n;
+	return 0;
+}
+
+/**
+ * Read the next line of the stream, without its newline. The line is valid
+ * until the next call.
+ * Returns 1 if a line was read, 0 at the end of the stream, or -1 on error.
+ */
+static int stream_line(struct stream_s *st, const char **line, size_t *len)
+{
+	for(;;)
+	{
+		/* Look for a newline in the contiguous runs of unread
+		 * input. */
+		while(st->scanned < st->used)
+		{
+			const size_t pos = (st->head + st->scanned) %
+				STREAM_BUF_SIZE;
+			size_t run = STREAM_BUF_SIZE - pos;
+			const char *nl;
+
+			if(run > st->used - st->scanned)
+				run = st->used - st->scanned;
+
+			nl = memchr(st->ring + pos, '\n', run);
+			if(nl != NULL)
+			{
+				st->scanned += (size_t)(nl - (st->ring + pos));
+				goto found;
+			}
+
+			st->scanned += run;
+		}
+
+		if(st->eof)
+		{
+			/* Last line may not be terminated by a newline. */
+			if(st->used == 0)
+				return 0;
+
+			goto found;
+		}
+
+		if(st->used == STREAM_BUF_SIZE)
+		{
+			fprintf(stderr, "ERR: Line longer than %d bytes\n",
+					STREAM_BUF_SIZE);
+			return -1;
+		}
+
+		if(stream_fill(st) != 0)
+			return -1;
+	}
+
+found:
+	*len = st->scanned;
+	if(st->head + *len <= STREAM_BUF_SIZE)
+		*line = st->ring + st->head;
+	else
+	{
+		const size_t first = STREAM_BUF_SIZE - st->head;
+
+		memcpy(st->line, st->ring + st->head, first);
+		memcpy(st->line + first, st->ring, *len - first);
+		*line = st->line;
+	}
+
+	/* Consume the line and its newline, if any. */
+	if(st->scanned < st->used)
+		st->scanned++;
+
+	st->head = (st->head + st->scanned) % STREAM_BUF_SIZE;
+	st->used -= st->scanned;
+	st->scanned = 0;
+	return 1;
+}
+
+/**
+ * Start a section read line by line. The section is appended to the table,
+ * unless a later ini is merged and the table already has an entry of the same
+ * MD5, in which case its keys are applied to that entry.
+ */
+static void next_section(struct parser_s *p, const char *line, size_t len)
+{
+	struct rom_table_s *t = p->t;
+	uint8_t md5[16];
+	uint32_t found;
+
+	p->in_section = 1;
+	if(p->overlay != NULL && md5_from_hex(md5, line + 1, line + len) == 0 &&
+			(found = md5_map_find(p->overlay, md5)) !=
+			MD5_MAP_EMPTY)
+	{
+		p->entry = found;
+		p->merging = 1;
+		start_section(p, line, line + len);
+		return;
+	}
+
+	/* Keys before the first section are applied to the first entry, as by
+	 * convert_lines(). */
+	p->entry = p->sections++;
+	p->merging = 0;
+	if(p->sections > t->entries)
+		table_grow(t, t->entries * 2 + 16);
+
+	start_section(p, line, line + len);
+	if(p->overlay != NULL)
+		md5_map_insert(p->overlay, t->md5[p->entry], (uint32_t)p->entry);
+}
+
+/**
+ * Convert one line of an ini that is read line by line.
+ */
+static void convert_line(struct parser_s *p, const char *line, size_t len)
+{
+	const char *eq;
+
+	/* Skip empty lines and comments. */
+	if(len == 0 || *line == ';')
+		return;
+
+	if(*line == '[')
+	{
+		next_section(p, line, len);
+		return;
+	}
+
+	if(p->overlay != NULL && !p->in_section)
+	{
+		fprintf(stderr, "WARNING: Ignoring key outside of a section "
+				"'%.*s'\n", (int)len, line);
+		return;
+	}
+
+	eq = memchr(line, '=', len);
+	apply_key(p, line, line + len, eq != NULL ? (size_t)(eq - line) : len);
+}
+
+/**
+ * Convert all lines read from a stream. The lines are hashed onto hash, as by
+ * hash_lines().
+ * Returns 0 on success, or -1 on error.
+ */
+static int stream_lines(int fd, struct parser_s *p, uint64_t *hash)
+{
+	struct stream_s st = { .fd = fd };
+	const char *line;
+	size_t len;
+	int ret;
+
+	st.ring = malloc(STREAM_BUF_SIZE);
+	st.line = malloc(STREAM_BUF_SIZE);
+	assert(st.ring != NULL && st.line != NULL);
+
+	while((ret = stream_line(&st, &line, &len)) > 0)
+	{
+		if(len != 0 && *line != ';')
+			*hash = hash_bytes(*hash, line, len);
+
+		convert_line(p, line, len);
+	}
+
+	free(st.ring);
+	free(st.line);
+	return ret;
+}
+
+/**
+ * Convert all entries of an ini read from a stream into the table. Lines are
+ * converted as they are read, as the number of entries is not known in
+ * advance. The lines of the ini are hashed onto hash, as by hash_lines().
+ * All allocations are from arena, unless it is NULL.
+ * Returns 0 on success, or -1 on error.
+ */
+int convert_stream(int fd, struct rom_table_s *t, struct cheat_table_s *ct,
+		struct arena_s *arena, uint64_t *hash)
+{
+	struct parser_s p;
+	int ret;
+
+	memset(&p, 0, sizeof(p));
+	p.t = t;
+	p.cheats.tot = 1;
+	p.cheats.arena = arena;
+	strbuf_init(&p.names, arena);
+	table_alloc(t, 1024, arena);
+
+	ret = stream_lines(fd, &p, hash);
+
+	t->entries = p.sections;
+	merge_cheats(ct, &p.cheats, t->cheat, p.sections, t->names.len - 1);
+	merge_names(t, &p.names, 0, p.sections);
+	strbuf_free(&p.names);
+
+	return ret;
+}
+
+/**
+ * Merge a later ini into the table. Keys of sections whose MD5 the table
+ * already has replace the values of that entry; other sections are appended.
+ * Each key read is added to the log, with the given index of the file. The
+ * lines of the ini are hashed onto hash, as by hash_lines().
+ * Returns 0 on success, or -1 on error.
+ */
+int merge_overlay(const char *filename, unsigned file, struct rom_table_s *t,
+		struct cheat_table_s *ct, struct md5_map_s *map,
+		struct prov_log_s *log, uint64_t *hash)
+{
+	const int use_stdin = strcmp(filename, "-") == 0;
+	struct parser_s p;
+	struct stat st;
+	int ret = 0;
+
+	memset(&p, 0, sizeof(p));
+	p.t = t;
+	p.sections = t->entries;
+	p.overlay = map;
+	p.prov = log;
+	p.file = file;
+
+	/* The names and cheats are added to those of the table directly, so
+	 * that entries may share them. */
+	p.names = t->names;
+	p.cheats = *ct;
+
+	if(use_stdin || (stat(filename, &st) == 0 && !S_ISREG(st.st_mode)))
+	{
+		int fd = use_stdin ? STDIN_FILENO : open(filename, O_RDONLY);
+
+		if(fd < 0)
+		{
+			PRINTERR();
+			ret = -1;
+		}
+		else
+		{
+			ret = stream_lines(fd, &p, hash);
+			if(!use_stdin)
+				close(fd);
+		}
+	}
+	else
+	{
+		struct ini_map_s ini;
+		struct ini_index_s idx;
+
+		if(map_file(filename, &ini) != 0)
+			ret = -1;
+		else
+		{
+			ini_scan(ini.buf, ini.len, &idx, NULL);
+			*hash = hash_lines(*hash, ini.buf, &idx);
+			for(size_t li = 0; li < idx.nlines; li++)
+			{
+				convert_line(&p, ini.buf + idx.lines[li].start,
+						idx.lines[li].len);
+			}
+
+			ini_index_free(&idx);
+			unmap_file(&ini);
+		}
+	}
+
+	t->names = p.names;
+	*ct = p.cheats;
+	t->entries = p.sections;
+	return ret;
+}
+
+static int compare_prov(const void *in1, const void *in2)
+{
+	const struct prov_s *a = in1, *b = in2;
+
+	if(a->entry != b->entry)
+		return a->entry < b->entry ? -1 : 1;
+	if(a->key != b->key)
+		return a->key < b->key ? -1 : 1;
+	return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+/**
+ * Whether a key sets the configuration of an entry, which is not used if the
+ * entry refers to another.
+ */
+static int key_configures(const struct ini_key_s *k)
+{
+	return k->handler != key_crc && k->handler != key_refmd5 &&
+		k->handler != key_goodname;
+}
+
+/**
+ * Report and remove the configuration keys in the log that were set on entries
+ * which refer to another entry, once all files are merged. Such entries only
+ * write their reference to the header, so the keys are not used.
+ */
+static void drop_unused_keys(const struct rom_table_s *t,
+		struct prov_log_s *log, char *const files[])
+{
+	size_t out = 0;
+
+	for(size_t i = 0; i < log->n; i++)
+	{
+		const struct prov_s *r = &log->recs[i];
+		const struct ini_key_s *k = &ini_keys[r->key];
+
+		if(t->conf[r->entry].reference && key_configures(k))
+		{
+			fprintf(stderr, "WARNING: %s from %s is not used, as "
+					"%s refers to another entry\n",
+					k->name, files[r->file],
+					table_name(t, r->entry));
+			continue;
+		}
+
+		log->recs[out++] = *r;
+	}
+
+	log->n = out;
+}
+
+/**
+ * Write the file that each key read from a later ini was last set by, grouped
+ * by entry. This must be called before the table is sorted, as the log refers
+ * to entries by index. The log is sorted.
+ */
+void dump_provenance(const char *filename, const struct rom_table_s *t,
+		struct prov_log_s *log, char *const files[])
+{
+	struct prov_s *r = log->recs;
+	uint32_t listed = UINT32_MAX;
+	char hex[33];
+	char *tmp;
+	FILE *f = open_output(filename, &tmp);
+
+	if(f == NULL)
+		return;
+
+	qsort(r, log->n, sizeof(*r), compare_prov);
+	fprintf(f, "; Keys that are not listed are from %s\n", files[0]);
+
+	for(size_t i = 0; i < log->n; i++)
+	{
+		const struct ini_key_s *k = &ini_keys[r[i].key];
+
+		/* Only the last file to set a key is listed. */
+		if(i + 1 < log->n && r[i + 1].entry == r[i].entry &&
+				r[i + 1].key == r[i].key)
+			continue;
+
+		if(r[i].entry != listed)
+		{
+			listed = r[i].entry;
+			fprintf(f, "\n[%s]\n; %s\n",
+					md5_to_hex(hex, t->md5[listed]),
+					table_name(t, listed));
+		}
+
+		fprintf(f, "%s=%s\n", k->name, files[r[i].file]);
+	}
+
+	close_output(f, filename, tmp);
+}
+
+enum lookup_e
+{
+	/* rom_crc[] is sorted, for binary search. */
+	LOOKUP_SORTED,
+	/* rom_crc[] is in Eytzinger (breadth first) order. */
+	LOOKUP_EYTZINGER,
+	/* rom_crc[] is ordered by a minimal perfect hash of the CRC. */
+	LOOKUP_MPHF,
+	/* rom_crc[] is an implicit B-tree of BTREE_KEYS keys per node. */
+	LOOKUP_BTREE,
+	/* rom_crc[] is sorted, and searched through a 32-bit index of CRC1. */
+	LOOKUP_SPLIT
+};
+
+/* Eight 64-bit keys fill a cache line, and two AVX2 compares. */
+#define BTREE_KEYS	8
+
+/**
+ * Order in which entries are written to the header. rom_crc[] and rom_dat[]
+ * share this order, so that both are indexed by position.
+ */
+struct layout_s
+{
+	enum lookup_e lookup;
+	size_t entries;
+
+	/* Entry at each position. */
+	uint32_t *order;
+	/* Position of each entry. */
+	uint32_t *pos;
+
+	/* Displacement seed of each bucket, for LOOKUP_MPHF. */
+	uint32_t *seed;
+	uint32_t buckets;
+	uint32_t max_seed;
+
+	/* Unique CRC1 values and their entry, or SPLIT_COLLISION and the first
+	 * element of the collision table, for LOOKUP_SPLIT. */
+	uint32_t *crc1;
+	uint32_t *crc1_entry;
+	uint32_t crc1_n;
+
+	/* CRC2 and entry of ROMs that share a CRC1. The last of each group is
+	 * marked with SPLIT_LAST. */
+	uint32_t *coll_crc2;
+	uint32_t *coll_entry;
+	uint32_t coll_n;
+};
+
+#define SPLIT_COLLISION	UINT32_C(0x80000000)
+#define SPLIT_LAST	UINT32_C(0x80000000)
+
+/**
+ * Place the entries of the sorted array [i, ...) into the Eytzinger tree rooted
+ * at 1-based node k.
+ * Returns the next sorted entry to place.
+ */
+static uint32_t eytzinger_fill(uint32_t *order, size_t entries, uint32_t i,
+		size_t k)
+{
+	if(k > entries)
+		return i;
+
+	i = eytzinger_fill(order, entries, i, 2 * k);
+	order[k - 1] = i++;
+	return eytzinger_fill(order, entries, i, 2 * k + 1);
+}
+
+/**
+ * Place the entries of the sorted array [i, ...) into the implicit B-tree
+ * rooted at node k. Node k holds positions [BTREE_KEYS * k, ...) and child c
+ * of node k is node (BTREE_KEYS + 1) * k + c + 1. Only the last node may be
+ * partly filled.
+ * Returns the next sorted entry to place.
+ */
+static uint32_t btree_fill(uint32_t *order, size_t entries, uint32_t i,
+		size_t k)
+{
+	const size_t base = BTREE_KEYS * k;
+	size_t c;
+
+	if(base >= entries)
+		return i;
+
+	for(c = 0; c < BTREE_KEYS && base + c < entries; c++)
+	{
+		i = btree_fill(order, entries, i, (BTREE_KEYS + 1) * k + c + 1);
+		order[base + c] = i++;
+	}
+
+	return btree_fill(order, entries, i, (BTREE_KEYS + 1) * k + c + 1);
+}
+
+#define MPHF_GOLDEN	UINT64_C(0x9E3779B97F4A7C15)
+
+/**
+ * Finaliser of SplitMix64, used as the hash function of the minimal perfect
+ * hash. The same function is written into the header.
+ */
+static uint64_t mphf_mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= UINT64_C(0xBF58476D1CE4E5B9);
+	x ^= x >> 27;
+	x *= UINT64_C(0x94D049BB133111EB);
+	x ^= x >> 31;
+	return x;
+}
+
+/**
+ * Map the upper half of a hash to [0, n) without a division.
+ */
+static uint32_t mphf_range(uint64_t h, uint32_t n)
+{
+	return (uint32_t)(((h >> 32) * n) >> 32);
+}
+
+static uint32_t mphf_bucket(uint64_t crc, uint32_t buckets)
+{
+	return mphf_range(mphf_mix(crc), buckets);
+}
+
+static uint32_t mphf_slot(uint64_t crc, uint32_t seed, uint32_t n)
+{
+	return mphf_range(mphf_mix(crc + (seed + UINT64_C(1)) * MPHF_GOLDEN), n);
+}
+
+/**
+ * Build a minimal perfect hash of the CRCs using hash and displace: keys are
+ * split into buckets, and for each bucket, largest first, a seed is searched
+ * for that places all of its keys into free slots.
+ * Returns 0 on success, or -1 if a bucket needs more than max_tries seeds.
+ */
+static int mphf_build(const uint64_t *crc, uint32_t n, uint32_t buckets,
+		uint32_t max_tries, uint32_t *seed, uint32_t *order,
+		uint32_t *max_seed)
+{
+	uint32_t *start = calloc(buckets + 2, sizeof(*start));
+	uint32_t *keys = malloc((n + 1) * sizeof(*keys));
+	uint32_t *by_size = malloc((buckets + 1) * sizeof(*by_size));
+	uint32_t *size_start;
+	uint8_t *taken = calloc(n + 1, 1);
+	uint32_t slots[64];
+	uint32_t max_size = 0;
+	int ret = 0;
+
+	assert(start != NULL && keys != NULL && by_size != NULL &&
+			taken != NULL);
+	*max_seed = 0;
+
+	/* Group the keys by bucket. */
+	for(uint32_t i = 0; i < n; i++)
+		start[mphf_bucket(crc[i], buckets) + 2]++;
+	for(uint32_t b = 0; b < buckets; b++)
+	{
+		if(start[b + 2] > max_size)
+			max_size = start[b + 2];
+		start[b + 2] += start[b + 1];
+	}
+	for(uint32_t i = 0; i < n; i++)
+		keys[start[mphf_bucket(crc[i], buckets) + 1]++] = i;
+
+	/* Keys of bucket b are now keys[start[b], start[b + 1]). Order the
+	 * buckets by decreasing size with a counting sort. */
+	size_start = calloc(max_size + 2, sizeof(*size_start));
+	assert(size_start != NULL);
+	for(uint32_t b = 0; b < buckets; b++)
+		size_start[max_size - (start[b + 1] - start[b]) + 1]++;
+	for(uint32_t s = 0; s <= max_size; s++)
+		size_start[s + 1] += size_start[s];
+	for(uint32_t b = 0; b < buckets; b++)
+		by_size[size_start[max_size - (start[b + 1] - start[b])]++] = b;
+
+	if(max_size > sizeof(slots) / sizeof(*slots))
+	{
+		ret = -1;
+		goto out;
+	}
+
+	for(uint32_t bi = 0; bi < buckets; bi++)
+	{
+		const uint32_t b = by_size[bi];
+		const uint32_t size = start[b + 1] - start[b];
+		uint32_t s;
+
+		if(size == 0)
+		{
+			seed[b] = 0;
+			continue;
+		}
+
+		for(s = 0; s < max_tries; s++)
+		{
+			uint32_t k;
+
+			for(k = 0; k < size; k++)
+			{
+				slots[k] = mphf_slot(crc[keys[start[b] + k]], s, n);
+				if(taken[slots[k]])
+					break;
+
+				/* Keys of this bucket may not collide with
+				 * each other either. */
+				taken[slots[k]] = 1;
+			}
+
+			if(k == size)
+				break;
+
+			while(k-- > 0)
+				taken[slots[k]] = 0;
+		}
+
+		if(s == max_tries)
+		{
+			ret = -1;
+			goto out;
+		}
+
+		seed[b] = s;
+		if(s > *max_seed)
+			*max_seed = s;
+
+		for(uint32_t k = 0; k < size; k++)
+			order[slots[k]] = keys[start[b] + k];
+	}
+
+out:
+	free(size_start);
+	free(taken);
+	free(by_size);
+	free(keys);
+	free(start);
+	return ret;
+}
+
+/**
+ * Build the CRC1 index of a sorted table. Entries sharing a CRC1 are adjacent,
+ * so each run of them becomes one group of the collision table.
+ */
+static void split_index(const struct rom_table_s *t, struct layout_s *l)
+{
+	const size_t n = t->entries;
+
+	l->crc1 = malloc((n + 1) * sizeof(*l->crc1));
+	l->crc1_entry = malloc((n + 1) * sizeof(*l->crc1_entry));
+	l->coll_crc2 = malloc((n + 1) * sizeof(*l->coll_crc2));
+	l->coll_entry = malloc((n + 1) * sizeof(*l->coll_entry));
+	assert(l->crc1 != NULL && l->crc1_entry != NULL &&
+			l->coll_crc2 != NULL && l->coll_entry != NULL);
+	assert(n < SPLIT_COLLISION);
+
+	for(size_t i = 0; i < n;)
+	{
+		const uint32_t c1 = (uint32_t)(t->crc[i] >> 32);
+		size_t j = i + 1;
+
+		while(j < n && (uint32_t)(t->crc[j] >> 32) == c1)
+			j++;
+
+		l->crc1[l->crc1_n] = c1;
+
+		if(j - i == 1)
+			l->crc1_entry[l->crc1_n++] = (uint32_t)i;
+		else
+		{
+			l->crc1_entry[l->crc1_n++] = SPLIT_COLLISION | l->coll_n;
+
+			for(size_t k = i; k < j; k++)
+			{
+				l->coll_crc2[l->coll_n] =
+					(uint32_t)(t->crc[k] & 0xFFFFFFFF);
+				l->coll_entry[l->coll_n++] = (uint32_t)k |
+					(k == j - 1 ? SPLIT_LAST : 0);
+			}
+		}
+
+		i = j;
+	}
+}
+
+void compute_layout(const struct rom_table_s *t, enum lookup_e lookup,
+		struct layout_s *l)
+{
+	memset(l, 0, sizeof(*l));
+	l->lookup = lookup;
+	l->entries = t->entries;
+	l->order = malloc((t->entries + 1) * sizeof(*l->order));
+	l->pos = malloc((t->entries + 1) * sizeof(*l->pos));
+	assert(l->order != NULL && l->pos != NULL);
+
+	switch(lookup)
+	{
+	case LOOKUP_SORTED:
+		for(size_t i = 0; i < t->entries; i++)
+			l->order[i] = (uint32_t)i;
+		break;
+
+	case LOOKUP_EYTZINGER:
+		eytzinger_fill(l->order, t->entries, 0, 1);
+		break;
+
+	case LOOKUP_BTREE:
+		btree_fill(l->order, t->entries, 0, 0);
+		break;
+
+	case LOOKUP_SPLIT:
+		for(size_t i = 0; i < t->entries; i++)
+			l->order[i] = (uint32_t)i;
+
+		split_index(t, l);
+		break;
+
+	case LOOKUP_MPHF:
+	{
+		const uint32_t n = (uint32_t)t->entries;
+
+		/* Start with an average of four keys per bucket, and add
+		 * buckets until every bucket finds a seed. */
+		l->buckets = n / 4 + 1;
+		for(;;)
+		{
+			l->seed = malloc(l->buckets * sizeof(*l->seed));
+			assert(l->seed != NULL);
+
+			if(mphf_build(t->crc, n, l->buckets, UINT32_C(1) << 20,
+					l->seed, l->order, &l->max_seed) == 0)
+				break;
+
+			free(l->seed);
+			l->buckets += l->buckets / 4 + 1;
+		}
+
+		/* Verify that every CRC maps to its own entry. */
+		for(uint32_t i = 0; i < n; i++)
+		{
+			uint32_t b = mphf_bucket(t->crc[i], l->buckets);
+			uint32_t slot = mphf_slot(t->crc[i], l->seed[b], n);
+
+			assert(l->order[slot] == i);
+			(void)slot;
+		}
+
+		break;
+	}
+	}
+
+	for(size_t p = 0; p < t->entries; p++)
+		l->pos[l->order[p]] = (uint32_t)p;
+}
+
+void free_layout(struct layout_s *l)
+{
+	free(l->order);
+	free(l->pos);
+	free(l->seed);
+	free(l->crc1);
+	free(l->crc1_entry);
+	free(l->coll_crc2);
+	free(l->coll_entry);
+	memset(l, 0, sizeof(*l));
+}
+
+/**
+ * Write rom_dat_find(), which matches the layout of rom_crc[], and
+ * rom_dat_lookup(), which is the same for every layout.
+ */
+static void dump_lookup(FILE *f, const struct layout_s *l, int compact)
+{
+	switch(l->lookup)
+	{
+	case LOOKUP_SORTED:
+		fprintf(f, "\n/**\n"
+			" * Find the position of a ROM in rom_crc[] and rom_dat[],"
+			" where crc is\n"
+			" * (CRC1 << 32) | CRC2. rom_crc[] is sorted, so this is a "
+			"binary search.\n"
+			" * Returns -1 if the ROM is not found.\n"
+			" */\n"
+			"static inline int32_t rom_dat_find(uint64_t crc)\n"
+			"{\n"
+			"\tconst uint32_t n = sizeof(rom_crc) / sizeof(*rom_crc);\n"
+			"\tuint32_t lo = 0, hi = n;\n\n"
+			"\twhile(lo < hi)\n"
+			"\t{\n"
+			"\t\tuint32_t mid = lo + (hi - lo) / 2;\n\n"
+			"\t\tif(rom_crc[mid] < crc)\n"
+			"\t\t\tlo = mid + 1;\n"
+			"\t\telse\n"
+			"\t\t\thi = mid;\n"
+			"\t}\n\n"
+			"\tif(lo == n || rom_crc[lo] != crc)\n"
+			"\t\treturn -1;\n\n"
+			"\treturn (int32_t)lo;\n"
+			"}\n\n");
+		break;
+
+	case LOOKUP_SPLIT:
+	{
+		/* Entries are 16-bit if both they and the collision table fit
+		 * below the flag bit. */
+		const int narrow = l->entries <= 0x7FFF && l->coll_n <= 0x7FFF;
+		const uint32_t flag = narrow ? 0x8000 : SPLIT_COLLISION;
+		const size_t full = l->entries * sizeof(uint64_t);
+		const size_t index = l->crc1_n * sizeof(uint32_t) +
+			l->crc1_n * (narrow ? 2 : 4) +
+			l->coll_n * 2 * sizeof(uint32_t);
+
+		fprintf(f, "\n/* Sorted unique CRC1 values of rom_crc[]. */\n");
+		fprintf(f, "const uint32_t rom_crc1[%"PRIu32"] = {", l->crc1_n);
+		for(uint32_t i = 0; i < l->crc1_n; i++)
+		{
+			fprintf(f, "%s0x%08"PRIX32"%s",
+					i % 6 == 0 ? "\n\t" : " ", l->crc1[i],
+					i == l->crc1_n - 1 ? "" : ",");
+		}
+		fprintf(f, "\n};\n\n");
+
+		fprintf(f, "#define ROM_CRC1_COLLISION\t0x%"PRIX32"u\n"
+			"#define ROM_CRC2_LAST\t\t0x%08"PRIX32"u\n\n",
+			flag, SPLIT_LAST);
+
+		fprintf(f, "/* Entry of each CRC1, or ROM_CRC1_COLLISION and the "
+				"first element of\n"
+				" * rom_crc2[] if ROMs share the CRC1. */\n");
+		fprintf(f, "const %s rom_crc1_entry[%"PRIu32"] = {",
+				narrow ? "uint16_t" : "uint32_t", l->crc1_n);
+		for(uint32_t i = 0; i < l->crc1_n; i++)
+		{
+			uint32_t e = l->crc1_entry[i];
+
+			if(e & SPLIT_COLLISION)
+				e = (e & ~SPLIT_COLLISION) | flag;
+
+			fprintf(f, "%s0x%0*"PRIX32"%s",
+					i % 6 == 0 ? "\n\t" : " ",
+					narrow ? 4 : 8, e,
+					i == l->crc1_n - 1 ? "" : ",");
+		}
+		fprintf(f, "\n};\n\n");
+
+		/* An empty array is not valid C. */
+		fprintf(f, "/* CRC2 and entry of ROMs sharing a CRC1. The entry "
+				"of the last ROM of each\n"
+				" * group has ROM_CRC2_LAST set. */\n");
+		fprintf(f, "const uint32_t rom_crc2[%"PRIu32"][2] = {",
+				l->coll_n == 0 ? 1 : l->coll_n);
+		for(uint32_t i = 0; i < l->coll_n; i++)
+		{
+			fprintf(f, "%s{ 0x%08"PRIX32", 0x%08"PRIX32" }%s",
+					i % 2 == 0 ? "\n\t" : " ",
+					l->coll_crc2[i], l->coll_entry[i],
+					i == l->coll_n - 1 ? "" : ",");
+		}
+		fprintf(f, "%s\n};\n\n", l->coll_n == 0 ? "\n\t{ 0, 0 }" : "");
+
+		fprintf(f, "/**\n"
+			" * Find the position of a ROM in rom_crc[] and rom_dat[],"
+			" where crc is\n"
+			" * (CRC1 << 32) | CRC2. The binary search is done over "
+			"the 32-bit CRC1 values\n"
+			" * in rom_crc1[], and the CRC2 is then checked.\n"
+			" * Returns -1 if the ROM is not found.\n"
+			" */\n"
+			"static inline int32_t rom_dat_find(uint64_t crc)\n"
+			"{\n"
+			"\tconst uint32_t n = sizeof(rom_crc1) / sizeof(*rom_crc1);"
+			"\n"
+			"\tconst uint32_t c1 = (uint32_t)(crc >> 32);\n"
+			"\tconst uint32_t c2 = (uint32_t)crc;\n"
+			"\tuint32_t lo = 0, hi = n, e;\n\n"
+			"\twhile(lo < hi)\n"
+			"\t{\n"
+			"\t\tuint32_t mid = lo + (hi - lo) / 2;\n\n"
+			"\t\tif(rom_crc1[mid] < c1)\n"
+			"\t\t\tlo = mid + 1;\n"
+			"\t\telse\n"
+			"\t\t\thi = mid;\n"
+			"\t}\n\n"
+			"\tif(lo == n || rom_crc1[lo] != c1)\n"
+			"\t\treturn -1;\n\n"
+			"\te = rom_crc1_entry[lo];\n"
+			"\tif((e & ROM_CRC1_COLLISION) == 0)\n"
+			"\t\treturn rom_crc[e] == crc ? (int32_t)e : -1;\n\n"
+			"\tfor(e &= ~ROM_CRC1_COLLISION;; e++)\n"
+			"\t{\n"
+			"\t\tif(rom_crc2[e][0] == c2)\n"
+			"\t\t\treturn (int32_t)(rom_crc2[e][1] & "
+			"~ROM_CRC2_LAST);\n\n"
+			"\t\tif(rom_crc2[e][1] & ROM_CRC2_LAST)\n"
+			"\t\t\treturn -1;\n"
+			"\t}\n"
+			"}\n\n");
+
+		printf("Split index: %"PRIu32" CRC1 values, %"PRIu32" ROMs "
+				"share a CRC1\n"
+				"  searched: %zu bytes (rom_crc[] is %zu bytes)\n"
+				"  index:    %zu bytes\n",
+				l->crc1_n, l->coll_n,
+				l->crc1_n * sizeof(uint32_t), full, index);
+		break;
+	}
+
+	case LOOKUP_BTREE:
+		fprintf(f, "\n#if defined(__AVX2__) || defined(__SSE4_2__)\n"
+			"# include <immintrin.h>\n"
+			"#endif\n\n"
+			"/**\n"
+			" * Count the keys of a full node of rom_crc[] that are "
+			"less than crc. SSE4.2\n"
+			" * and AVX2 only have a signed 64-bit compare, so the sign "
+			"bit of both sides\n"
+			" * is flipped first.\n"
+			" */\n"
+			"static inline uint32_t rom_btree_rank(const uint64_t *node,"
+			" uint64_t crc)\n"
+			"{\n"
+			"#if defined(__AVX2__)\n"
+			"\tconst __m256i sign = _mm256_set1_epi64x(INT64_MIN);\n"
+			"\tconst __m256i x = _mm256_xor_si256(\n"
+			"\t\t\t_mm256_set1_epi64x((int64_t)crc), sign);\n"
+			"\tconst __m256i a = _mm256_xor_si256(\n"
+			"\t\t\t_mm256_loadu_si256((const __m256i *)node), sign);\n"
+			"\tconst __m256i b = _mm256_xor_si256(\n"
+			"\t\t\t_mm256_loadu_si256((const __m256i *)(node + 4)), "
+			"sign);\n"
+			"\tint m = _mm256_movemask_pd(_mm256_castsi256_pd(\n"
+			"\t\t\t\t_mm256_cmpgt_epi64(x, a))) |\n"
+			"\t\t_mm256_movemask_pd(_mm256_castsi256_pd(\n"
+			"\t\t\t\t_mm256_cmpgt_epi64(x, b))) << 4;\n\n"
+			"\treturn (uint32_t)_mm_popcnt_u32((unsigned)m);\n"
+			"#elif defined(__SSE4_2__)\n"
+			"\tconst __m128i sign = _mm_set1_epi64x(INT64_MIN);\n"
+			"\tconst __m128i x = _mm_xor_si128("
+			"_mm_set1_epi64x((int64_t)crc), sign);\n"
+			"\tint m = 0;\n\n"
+			"\tfor(int i = 0; i < %d; i += 2)\n"
+			"\t{\n"
+			"\t\t__m128i a = _mm_xor_si128(\n"
+			"\t\t\t\t_mm_loadu_si128((const __m128i *)(node + i)), "
+			"sign);\n"
+			"\t\tm |= _mm_movemask_pd(_mm_castsi128_pd(\n"
+			"\t\t\t\t_mm_cmpgt_epi64(x, a))) << i;\n"
+			"\t}\n\n"
+			"\treturn (uint32_t)_mm_popcnt_u32((unsigned)m);\n"
+			"#else\n"
+			"\tuint32_t r = 0;\n\n"
+			"\tfor(int i = 0; i < %d; i++)\n"
+			"\t\tr += node[i] < crc;\n\n"
+			"\treturn r;\n"
+			"#endif\n"
+			"}\n\n"
+			"/**\n"
+			" * Find the position of a ROM in rom_crc[] and rom_dat[],"
+			" where crc is\n"
+			" * (CRC1 << 32) | CRC2. rom_crc[] is stored as an implicit "
+			"B-tree: node k is\n"
+			" * rom_crc[%d * k] to rom_crc[%d * k + %d], and child c of "
+			"node k is node\n"
+			" * %d * k + c + 1. Each node is searched with SIMD "
+			"compares where available.\n"
+			" * Returns -1 if the ROM is not found.\n"
+			" */\n"
+			"static inline int32_t rom_dat_find(uint64_t crc)\n"
+			"{\n"
+			"\tconst uint32_t n = sizeof(rom_crc) / sizeof(*rom_crc);\n"
+			"\tuint32_t k = 0;\n"
+			"\tint32_t found = -1;\n\n"
+			"\twhile(%d * k < n)\n"
+			"\t{\n"
+			"\t\tconst uint32_t base = %d * k;\n"
+			"\t\tuint32_t i;\n\n"
+			"\t\tif(n - base >= %d)\n"
+			"\t\t\ti = rom_btree_rank(rom_crc + base, crc);\n"
+			"\t\telse\n"
+			"\t\t{\n"
+			"\t\t\tfor(i = 0; base + i < n && rom_crc[base + i] < "
+			"crc; i++)\n"
+			"\t\t\t\t;\n"
+			"\t\t}\n\n"
+			"\t\t/* The first key not less than crc. */\n"
+			"\t\tif(i < %d && base + i < n)\n"
+			"\t\t\tfound = (int32_t)(base + i);\n\n"
+			"\t\tk = %d * k + i + 1;\n"
+			"\t}\n\n"
+			"\tif(found < 0 || rom_crc[found] != crc)\n"
+			"\t\treturn -1;\n\n"
+			"\treturn found;\n"
+			"}\n\n",
+			BTREE_KEYS, BTREE_KEYS,
+			BTREE_KEYS, BTREE_KEYS, BTREE_KEYS - 1, BTREE_KEYS + 1,
+			BTREE_KEYS, BTREE_KEYS, BTREE_KEYS, BTREE_KEYS,
+			BTREE_KEYS + 1);
+		break;
+
+	case LOOKUP_EYTZINGER:
+		fprintf(f, "\n/**\n"
+			" * Find the position of a ROM in rom_crc[] and rom_dat[],"
+			" where crc is\n"
+			" * (CRC1 << 32) | CRC2. rom_crc[] is stored in Eytzinger"
+			" order, so the search\n"
+			" * is branchless and prefetches four levels ahead.\n"
+			" * Returns -1 if the ROM is not found.\n"
+			" */\n"
+			"static inline int32_t rom_dat_find(uint64_t crc)\n"
+			"{\n"
+			"\tconst uint32_t n = sizeof(rom_crc) / sizeof(*rom_crc);\n"
+			"\tuint32_t k = 1;\n\n"
+			"\twhile(k <= n)\n"
+			"\t{\n"
+			"#if defined(__GNUC__)\n"
+			"\t\t/* Sixteen descendants four levels down are "
+			"contiguous. */\n"
+			"\t\t__builtin_prefetch((const char *)rom_crc +\n"
+			"\t\t\t\t(16 * k - 1) * sizeof(*rom_crc));\n"
+			"#endif\n"
+			"\t\tk = 2 * k + (rom_crc[k - 1] < crc);\n"
+			"\t}\n\n"
+			"\t/* Undo the right turns taken after the last left "
+			"turn. */\n"
+			"#if defined(__GNUC__)\n"
+			"\tk >>= __builtin_ffs((int)~k);\n"
+			"#else\n"
+			"\twhile(k & 1)\n"
+			"\t\tk >>= 1;\n"
+			"\tk >>= 1;\n"
+			"#endif\n\n"
+			"\tif(k == 0 || rom_crc[k - 1] != crc)\n"
+			"\t\treturn -1;\n\n"
+			"\treturn (int32_t)(k - 1);\n"
+			"}\n\n");
+		break;
+
+	case LOOKUP_MPHF:
+	{
+		const char *type = l->max_seed <= UINT16_MAX ?
+			"uint16_t" : "uint32_t";
+
+		fprintf(f, "\n/* Displacement seeds of the minimal perfect hash "
+				"of rom_crc[]. */\n");
+		fprintf(f, "static const %s rom_mphf_seed[%"PRIu32"] = {",
+				type, l->buckets);
+		for(uint32_t b = 0; b < l->buckets; b++)
+		{
+			fprintf(f, "%s%"PRIu32"%s", b % 12 == 0 ? "\n\t" : " ",
+					l->seed[b],
+					b == l->buckets - 1 ? "" : ",");
+		}
+		fprintf(f, "\n};\n\n");
+
+		fprintf(f, "static inline uint64_t rom_mphf_mix(uint64_t x)\n"
+			"{\n"
+			"\tx ^= x >> 30;\n"
+			"\tx *= UINT64_C(0xBF58476D1CE4E5B9);\n"
+			"\tx ^= x >> 27;\n"
+			"\tx *= UINT64_C(0x94D049BB133111EB);\n"
+			"\tx ^= x >> 31;\n"
+			"\treturn x;\n"
+			"}\n\n"
+			"/**\n"
+			" * Find the position of a ROM in rom_crc[] and rom_dat[],"
+			" where crc is\n"
+			" * (CRC1 << 32) | CRC2. The position is given by a "
+			"minimal perfect hash of the\n"
+			" * CRC, so only one element of rom_crc[] is read.\n"
+			" * Returns -1 if the ROM is not found.\n"
+			" */\n"
+			"static inline int32_t rom_dat_find(uint64_t crc)\n"
+			"{\n"
+			"\tconst uint64_t n = sizeof(rom_crc) / sizeof(*rom_crc);\n"
+			"\tconst uint64_t nb = sizeof(rom_mphf_seed) / "
+			"sizeof(*rom_mphf_seed);\n"
+			"\tuint64_t b = ((rom_mphf_mix(crc) >> 32) * nb) >> 32;\n"
+			"\tuint64_t h = rom_mphf_mix(crc +\n"
+			"\t\t\t(rom_mphf_seed[b] + UINT64_C(1)) *\n"
+			"\t\t\tUINT64_C(0x9E3779B97F4A7C15));\n"
+			"\tuint32_t slot = (uint32_t)(((h >> 32) * n) >> 32);\n\n"
+			"\tif(rom_crc[slot] != crc)\n"
+			"\t\treturn -1;\n\n"
+			"\treturn (int32_t)slot;\n"
+			"}\n\n");
+		break;
+	}
+	}
+
+	if(compact)
+	{
+		fprintf(f, "/**\n"
+			" * Find the configuration of a ROM, where crc is "
+			"(CRC1 << 32) | CRC2.\n"
+			" * References are followed, so the returned value holds "
+			"the configuration.\n"
+			" * Returns NULL if the ROM is not found.\n"
+			" */\n"
+			"static inline const uint32_t *rom_dat_lookup(uint64_t crc)"
+			"\n"
+			"{\n"
+			"\tconst uint32_t *e;\n"
+			"\tint32_t i = rom_dat_find(crc);\n\n"
+			"\tif(i < 0)\n"
+			"\t\treturn NULL;\n\n"
+			"\te = &rom_dat[i];\n"
+			"\twhile(ROM_DAT_REFERENCE(*e))\n"
+			"\t\te = &rom_dat[ROM_DAT_REFERENCE_ENTRY(*e)];\n\n"
+			"\treturn e;\n"
+			"}\n\n");
+		return;
+	}
+
+	fprintf(f, "/**\n"
+		" * Find the configuration of a ROM, where crc is (CRC1 << 32) | "
+		"CRC2.\n"
+		" * References are followed, so the returned entry holds the "
+		"configuration.\n"
+		" * Returns NULL if the ROM is not found.\n"
+		" */\n"
+		"static inline const struct rom_entry_s *rom_dat_lookup("
+		"uint64_t crc)\n"
+		"{\n"
+		"\tconst struct rom_entry_s *e;\n"
+		"\tint32_t i = rom_dat_find(crc);\n\n"
+		"\tif(i < 0)\n"
+		"\t\treturn NULL;\n\n"
+		"\te = &rom_dat[i];\n"
+		"\twhile(e->reference)\n"
+		"\t\te = &rom_dat[e->reference_entry];\n\n"
+		"\treturn e;\n"
+		"}\n\n");
+}
+
+/**
+ * A GameShark code of a cheat, as "TTAAAAAA VVVV" with the code type T,
+ * address A and value V in hexadecimal.
+ */
+struct cheat_op_s
+{
+	uint32_t addr;
+	uint16_t val;
+	uint8_t type;
+};
+
+/**
+ * Codes of all cheats in one array. The codes of cheat i are
+ * ops[first[i], first[i + 1]).
+ */
+struct cheat_ops_s
+{
+	struct cheat_op_s *ops;
+	size_t nops;
+	uint32_t *first;
+	size_t cheats;
+};
+
+/**
+ * Parse a hexadecimal number of exactly the given number of digits.
+ * Returns 0 on success, or -1 if there are fewer digits.
+ */
+static int parse_hex(const char *p, const char *eol, size_t digits,
+		uint32_t *val)
+{
+	const char *endptr;
+
+	if(p >= eol || *p == ' ' || *p == '\t' || (size_t)(eol - p) < digits)
+		return -1;
+
+	*val = (uint32_t)parse_ul(p, p + digits, &endptr, 16);
+	return endptr == p + digits ? 0 : -1;
+}
+
+/**
+ * Parse the codes of a cheat, separated by commas, and append them to co.
+ * Returns 0 on success, or -1 if the cheat is malformed, in which case nothing
+ * is appended.
+ */
+static int parse_cheat(const char *s, size_t len, struct cheat_ops_s *co,
+		size_t *alloc)
+{
+	const char *p = s, *eol = s + len;
+	const size_t start = co->nops;
+
+	while(p < eol)
+	{
+		struct cheat_op_s *op;
+		uint32_t code, val;
+
+		if(eol - p < 13 || parse_hex(p, eol, 8, &code) != 0 ||
+				p[8] != ' ' || parse_hex(p + 9, eol, 4, &val) != 0)
+			goto err;
+
+		p += 13;
+		if(p < eol && *p++ != ',')
+			goto err;
+
+		/* A trailing comma is not a code. */
+		if(p == eol && p[-1] == ',')
+			goto err;
+
+		if(co->nops >= *alloc)
+		{
+			*alloc = *alloc == 0 ? 64 : *alloc * 2;
+			co->ops = realloc(co->ops, *alloc * sizeof(*co->ops));
+			assert(co->ops != NULL);
+		}
+
+		op = &co->ops[co->nops++];
+		op->type = (uint8_t)(code >> 24);
+		op->addr = code & 0xFFFFFF;
+		op->val = (uint16_t)val;
+	}
+
+	return 0;
+
+err:
+	co->nops = start;
+	return -1;
+}
+
+/**
+ * Parse the codes of every cheat. Malformed cheats are reported and left
+ * without codes.
+ */
+void build_cheat_ops(const struct cheat_table_s *ct, struct cheat_ops_s *co)
+{
+	size_t alloc = 0;
+
+	memset(co, 0, sizeof(*co));
+	co->cheats = ct->tot;
+	co->first = malloc((ct->tot + 1) * sizeof(*co->first));
+	assert(co->first != NULL);
+
+	for(size_t i = 0; i < ct->tot; i++)
+	{
+		assert(co->nops < UINT32_MAX);
+		co->first[i] = (uint32_t)co->nops;
+
+		if(i == 0)
+			continue;
+
+		if(parse_cheat(cheat_text(ct, i), ct->len[i], co, &alloc) != 0)
+		{
+			fprintf(stderr, "WARNING: Cheat %zu is malformed and is "
+					"ignored: %s\n", i, cheat_text(ct, i));
+		}
+	}
+
+	co->first[ct->tot] = (uint32_t)co->nops;
+}
+
+void free_cheat_ops(struct cheat_ops_s *co)
+{
+	free(co->ops);
+	free(co->first);
+	memset(co, 0, sizeof(*co));
+}
+
+/**
+ * Write the codes of the cheats in place of the cheat strings.
+ */
+static void dump_cheat_ops(FILE *f, const struct rom_table_s *t,
+		const struct cheat_table_s *ct, const struct cheat_ops_s *co)
+{
+	const int narrow = co->nops <= UINT16_MAX;
+
+	fprintf(f, "struct rom_cheat_op_s\n"
+		"{\n"
+		"\t/* Address, without the code type. */\n"
+		"\tuint32_t addr;\n"
+		"\tuint16_t val;\n"
+		"\t/* Code type, the first byte of the GameShark code. */\n"
+		"\tuint8_t type;\n"
+		"};\n\n");
+
+	fprintf(f, "struct rom_cheat_s\n"
+		"{\n"
+		"\t/* Codes of the cheat are rom_cheat_ops[off, off + len). */\n"
+		"\t%s off;\n"
+		"\t%s len;\n"
+		"};\n\n", narrow ? "uint16_t" : "uint32_t",
+		narrow ? "uint16_t" : "uint32_t");
+
+	/* An empty array is not valid C. */
+	fprintf(f, "const struct rom_cheat_op_s rom_cheat_ops[%zu] = {",
+			co->nops == 0 ? 1 : co->nops);
+	for(size_t i = 0; i < co->nops; i++)
+	{
+		const struct cheat_op_s *op = &co->ops[i];
+
+		fprintf(f, "%s{ 0x%06"PRIX32", 0x%04X, 0x%02X }%s",
+				i % 3 == 0 ? "\n\t" : " ", op->addr, op->val,
+				op->type, i == co->nops - 1 ? "" : ",");
+	}
+	fprintf(f, "%s\n};\n\n", co->nops == 0 ? "\n\t{ 0, 0, 0 }" : "");
+
+	fprintf(f, "const struct rom_cheat_s rom_cheat[%zu] = {\n", ct->tot);
+	fprintf(f, "\t{ 0, 0 },\n");
+	for(size_t i = 1; i < ct->tot; i++)
+	{
+		if(ct->first_user[i] != 0)
+		{
+			fprintf(f, "\n\t/**\n");
+			for(uint32_t u = ct->first_user[i]; u != 0;
+					u = ct->users[u].next)
+			{
+				fprintf(f, "\t * %s\n",
+					t->names.buf + ct->users[u].name);
+			}
+			fprintf(f, "\t */\n");
+		}
+
+		fprintf(f, "\t{ %"PRIu32", %"PRIu32" },\n", co->first[i],
+				co->first[i + 1] - co->first[i]);
+	}
+	fprintf(f, "};\n");
+}
+
+/**
+ * Goodnames and cheats packed into one buffer of null terminated strings.
+ * A string that is a suffix of another is stored only as the tail of it.
+ */
+struct str_pool_s
+{
+	char *buf;
+	size_t len;
+
+	/* Offset of the goodname of each entry, and of each cheat. */
+	uint32_t *name;
+	uint32_t *cheat;
+
+	/* Number of strings, and their size if stored separately. */
+	size_t strings;
+	size_t input;
+};
+
+struct pool_str_s
+{
+	const char *s;
+	size_t len;
+	uint32_t *off;
+};
+
+/**
+ * Order strings by their reversed characters, so that a string directly
+ * precedes the strings that it is a suffix of.
+ */
+static int compare_reversed(const void *in1, const void *in2)
+{
+	const struct pool_str_s *a = in1, *b = in2;
+	size_t i = a->len, j = b->len;
+
+	while(i > 0 && j > 0)
+	{
+		unsigned char ca = (unsigned char)a->s[--i];
+		unsigned char cb = (unsigned char)b->s[--j];
+
+		if(ca != cb)
+			return ca < cb ? -1 : 1;
+	}
+
+	return (a->len > b->len) - (a->len < b->len);
+}
+
+void build_pool(const struct rom_table_s *t, const struct cheat_table_s *ct,
+		struct str_pool_s *sp)
+{
+	const size_t cheats = ct == NULL ? 0 : ct->tot;
+	const size_t n = t->entries + cheats;
+	struct pool_str_s *str = malloc((n + 1) * sizeof(*str));
+	size_t k = 0;
+
+	memset(sp, 0, sizeof(*sp));
+	sp->name = malloc((t->entries + 1) * sizeof(*sp->name));
+	sp->cheat = malloc((cheats + 1) * sizeof(*sp->cheat));
+	assert(str != NULL && sp->name != NULL && sp->cheat != NULL);
+
+	for(size_t i = 0; i < t->entries; i++)
+	{
+		str[k].s = table_name(t, i);
+		str[k].len = strlen(str[k].s);
+		str[k++].off = &sp->name[i];
+	}
+
+	for(size_t i = 0; i < cheats; i++)
+	{
+		str[k].s = cheat_text(ct, i);
+		str[k].len = strlen(str[k].s);
+		str[k++].off = &sp->cheat[i];
+	}
+
+	qsort(str, n, sizeof(*str), compare_reversed);
+
+	/* Every string is at most as large as its input. */
+	for(size_t i = 0; i < n; i++)
+		sp->input += str[i].len + 1;
+
+	sp->buf = malloc(sp->input + 1);
+	assert(sp->buf != NULL);
+	sp->strings = n;
+
+	/* The last string of each run of suffixes is stored, and the others
+	 * point into its tail. */
+	for(size_t i = n; i-- > 0;)
+	{
+		const struct pool_str_s *next = &str[i + 1];
+
+		if(i + 1 < n && next->len >= str[i].len &&
+				memcmp(next->s + next->len - str[i].len,
+					str[i].s, str[i].len) == 0)
+		{
+			*str[i].off = *next->off +
+				(uint32_t)(next->len - str[i].len);
+			continue;
+		}
+
+		assert(sp->len + str[i].len < UINT32_MAX);
+		*str[i].off = (uint32_t)sp->len;
+		memcpy(sp->buf + sp->len, str[i].s, str[i].len + 1);
+		sp->len += str[i].len + 1;
+	}
+
+	free(str);
+}
+
+void free_pool(struct str_pool_s *sp)
+{
+	free(sp->buf);
+	free(sp->name);
+	free(sp->cheat);
+	memset(sp, 0, sizeof(*sp));
+}
+
+/**
+ * Write the string pool as one array. Each stored string is a separate
+ * literal on its own line, so that an escape never runs into the next string.
+ */
+static void dump_pool(FILE *f, const struct str_pool_s *sp,
+		const struct layout_s *l)
+{
+	const int narrow = sp->len <= UINT16_MAX + 1;
+	const char *type = narrow ? "uint16_t" : "uint32_t";
+
+	fprintf(f, "\n/* Goodnames and cheats. Strings that are the suffix of "
+			"another are stored\n"
+			" * only once. */\n");
+	fprintf(f, "const char rom_str_pool[%zu] =", sp->len);
+	for(size_t i = 0; i < sp->len; i += strlen(sp->buf + i) + 1)
+	{
+		const unsigned char *c = (const unsigned char *)sp->buf + i;
+
+		fprintf(f, "\n\t\"");
+		for(; *c != '\0'; c++)
+		{
+			if(*c == '"' || *c == '\\' || *c == '?')
+				fprintf(f, "\\%c", *c);
+			else if(*c < 0x20 || *c > 0x7E)
+				fprintf(f, "\\%03o", *c);
+			else
+				fputc(*c, f);
+		}
+
+		/* The terminator of the last string is that of the array. */
+		fprintf(f, "%s\"", i + strlen(sp->buf + i) + 1 == sp->len ?
+				"" : "\\0");
+	}
+	fprintf(f, ";\n\n");
+
+	fprintf(f, "/* Offset of the goodname of each entry in "
+			"rom_str_pool[]. */\n");
+	fprintf(f, "const %s rom_name[%zu] = {", type, l->entries);
+	for(size_t i = 0; i < l->entries; i++)
+	{
+		fprintf(f, "%s%"PRIu32"%s", i % 10 == 0 ? "\n\t" : " ",
+				sp->name[l->order[i]],
+				i == l->entries - 1 ? "" : ",");
+	}
+	fprintf(f, "\n};\n\n");
+
+	fprintf(f, "/**\n"
+		" * Returns the goodname of the entry at the given position of "
+		"rom_dat[].\n"
+		" */\n"
+		"static inline const char *rom_dat_name(int32_t i)\n"
+		"{\n"
+		"\treturn rom_str_pool + rom_name[i];\n"
+		"}\n\n");
+}
+
+/**
+ * Check that the target of each reference fits in the 16-bit reference_entry
+ * field of filename, where pos is the position of each entry in that file, or
+ * NULL if entries are written in table order.
+ * Returns 0 on success, or -1 after reporting the first that does not fit.
+ */
+static int check_refs(const struct rom_table_s *t, const uint32_t *ref_index,
+		const uint32_t *pos, const char *filename)
+{
+	for(size_t i = 0; i < t->entries; i++)
+	{
+		uint32_t ref;
+
+		if(t->conf[i].reference == 0)
+			continue;
+
+		ref = pos != NULL ? pos[ref_index[i]] : ref_index[i];
+		if(ref > UINT16_MAX)
+		{
+			fprintf(stderr, "ERR: Reference of %s to entry %u does "
+					"not fit in %s\n", table_name(t, i),
+					ref, filename);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Pack the configuration of an entry into the 32-bit layout described in
+ * romdb.h. For references, ref is the index of the referenced entry, which
+ * must fit in 16 bits.
+ */
+static uint32_t conf_pack(const union rom_conf_u *c, uint32_t ref,
+		uint32_t cheat)
+{
+	if(c->reference)
+	{
+		assert(ref <= UINT16_MAX);
+		return 1u | ref << 16;
+	}
+
+	return (uint32_t)c->save_type << 1 |
+		(uint32_t)c->players << 4 |
+		(uint32_t)c->rumble << 7 |
+		(uint32_t)c->transferpak << 8 |
+		(uint32_t)c->status << 9 |
+		(uint32_t)c->count_per_op << 12 |
+		(uint32_t)c->disable_extra_mem << 15 |
+		(cheat & 0x1F) << 16 |
+		(uint32_t)c->mempak << 21 |
+		(uint32_t)c->biopak << 22 |
+		(uint32_t)c->si_dma_duration << 23 |
+		(uint32_t)c->ai_dma_modifier << 24 |
+		(cheat >> 5 & 0x7F) << 25;
+}
+
+/**
+ * Buffer for the bulk of the header, written to the file in large chunks.
+ * Numbers are formatted by hand; going through printf for every field took
+ * most of the time needed to write large tables.
+ */
+struct outbuf_s
+{
+	FILE *f;
+	char *buf;
+	size_t len;
+};
+
+#define OUTBUF_SIZE	(256 * 1024)
+
+static void out_init(struct outbuf_s *ob, FILE *f)
+{
+	ob->f = f;
+	ob->len = 0;
+	ob->buf = malloc(OUTBUF_SIZE);
+	assert(ob->buf != NULL);
+}
+
+static void out_flush(struct outbuf_s *ob)
+{
+	if(ob->len != 0 && fwrite(ob->buf, 1, ob->len, ob->f) != ob->len)
+		PRINTERR();
+
+	ob->len = 0;
+}
+
+/**
+ * Flush the buffer and free it. The file is left open.
+ */
+static void out_free(struct outbuf_s *ob)
+{
+	out_flush(ob);
+	free(ob->buf);
+	ob->buf = NULL;
+}
+
+static void out_mem(struct outbuf_s *ob, const char *s, size_t len)
+{
+	if(ob->len + len > OUTBUF_SIZE)
+	{
+		out_flush(ob);
+
+		/* Too large to be worth copying. */
+		if(len > OUTBUF_SIZE)
+		{
+			if(fwrite(s, 1, len, ob->f) != len)
+				PRINTERR();
+			return;
+		}
+	}
+
+	memcpy(ob->buf + ob->len, s, len);
+	ob->len += len;
+}
+
+static void out_str(struct outbuf_s *ob, const char *s)
+{
+	out_mem(ob, s, strlen(s));
+}
+
+/**
+ * Write the lowest digits nibbles of v as upper case hexadecimal.
+ */
+static void out_hex(struct outbuf_s *ob, uint64_t v, unsigned digits)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	char tmp[16];
+
+	assert(digits <= sizeof(tmp));
+	for(unsigned i = digits; i-- > 0; v >>= 4)
+		tmp[i] = hex[v & 0xF];
+
+	out_mem(ob, tmp, digits);
+}
+
+static void out_dec(struct outbuf_s *ob, uint64_t v)
+{
+	char tmp[20];
+	size_t i = sizeof(tmp);
+
+	do
+	{
+		tmp[--i] = (char)('0' + v % 10);
+		v /= 10;
+	} while(v != 0);
+
+	out_mem(ob, tmp + i, sizeof(tmp) - i);
+}
+
+/**
+ * Write a designated initialiser "\t\t.name = v,\n".
+ */
+static void out_field(struct outbuf_s *ob, const char *name, unsigned v)
+{
+	out_str(ob, "\t\t.");
+	out_str(ob, name);
+	out_str(ob, " = ");
+	out_dec(ob, v);
+	out_str(ob, ",\n");
+}
+
+/**
+ * Write rom_dat_cheat(), and the side table of cheat indexes if there are
+ * more cheats than the records can index. The index is into rom_cheat[] if
+ * cheats are written as parsed codes, and into cheats[] otherwise.
+ */
+static void dump_cheat_index(FILE *f, const struct rom_table_s *t,
+		const struct layout_s *l, const struct cheat_table_s *ct,
+		int compact, int cheat_ops)
+{
+	const char *entry = compact ? "uint32_t" : "struct rom_entry_s";
+	const char *cheats = cheat_ops ? "rom_cheat" : "cheats";
+
+	if(ct->tot - 1 <= CHEAT_LUT_MAX)
+	{
+		fprintf(f, "/**\n"
+			" * Returns the index in %s[] of the cheat of an "
+			"entry, or 0 if it has none.\n"
+			" */\n"
+			"static inline uint32_t rom_dat_cheat(const %s *e)\n"
+			"{\n"
+			"\treturn %s;\n"
+			"}\n\n", cheats, entry,
+			compact ? "ROM_DAT_CHEAT_LUT(*e)" :
+			"e->cheat_lut | (uint32_t)e->cheat_lut_hi << 5");
+		return;
+	}
+
+	fprintf(f, "/* Index in %s[] of the cheat of each entry. There are "
+			"too many cheats\n"
+			" * for cheat_lut, which is always 0. */\n", cheats);
+	fprintf(f, "const uint32_t rom_cheat_lut[%zu] = {", l->entries);
+	for(size_t i = 0; i < l->entries; i++)
+	{
+		fprintf(f, "%s%"PRIu32"%s", i % 10 == 0 ? "\n\t" : " ",
+				t->cheat[l->order[i]],
+				i == l->entries - 1 ? "" : ",");
+	}
+	fprintf(f, "\n};\n\n");
+
+	fprintf(f, "/**\n"
+		" * Returns the index in %s[] of the cheat of an entry, or 0 "
+		"if it has none.\n"
+		" */\n"
+		"static inline uint32_t rom_dat_cheat(const %s *e)\n"
+		"{\n"
+		"\treturn rom_cheat_lut[e - rom_dat];\n"
+		"}\n\n", cheats, entry);
+}
+
+/**
+ * Write the macros that extract the fields of a packed rom_dat[] value in
+ * compact mode. The layout is that of conf_pack().
+ */
+static void dump_compact_macros(FILE *f)
+{
+	static const struct
+	{
+		const char *name;
+		unsigned shift;
+		unsigned mask;
+	} fields[] = {
+		{ "REFERENCE",		0,	0x1 },
+		{ "REFERENCE_ENTRY",	16,	0xFFFF },
+		{ "SAVE_TYPE",		1,	0x7 },
+		{ "PLAYERS",		4,	0x7 },
+		{ "RUMBLE",		7,	0x1 },
+		{ "TRANSFERPAK",	8,	0x1 },
+		{ "STATUS",		9,	0x7 },
+		{ "COUNT_PER_OP",	12,	0x7 },
+		{ "DISABLE_EXTRA_MEM",	15,	0x1 },
+		{ "MEMPAK",		21,	0x1 },
+		{ "BIOPAK",		22,	0x1 },
+		{ "SI_DMA_DURATION",	23,	0x1 },
+		{ "AI_DMA_MODIFIER",	24,	0x1 }
+	};
+
+	fprintf(f, "/**\n"
+		" * Fields of a packed rom_dat[] value. If ROM_DAT_REFERENCE is "
+		"set, the only\n"
+		" * other field is ROM_DAT_REFERENCE_ENTRY, which is the 16-bit "
+		"index of the\n"
+		" * entry holding the configuration.\n"
+		" */\n");
+	for(size_t i = 0; i < sizeof(fields) / sizeof(*fields); i++)
+	{
+		fprintf(f, "#define ROM_DAT_%s(c)\t%s(((c) >> %u) & 0x%X)\n",
+				fields[i].name,
+				strlen(fields[i].name) < 10 ? "\t" : "",
+				fields[i].shift, fields[i].mask);
+	}
+	fprintf(f, "#define ROM_DAT_CHEAT_LUT(c)\t((((c) >> 16) & 0x1F) | "
+			"(((c) >> 25) & 0x7F) << 5)\n\n");
+}
+
+/**
+ * Write rom_dat[] as packed 32-bit values instead of initialisers. References
+ * must have been checked with check_refs(), as conf_pack() only has 16 bits
+ * for them.
+ */
+static void dump_compact(struct outbuf_s *ob, const struct rom_table_s *t,
+		const uint32_t *ref_index, const struct layout_s *l,
+		const struct cheat_table_s *ct)
+{
+	const size_t entries = t->entries;
+
+	out_str(ob, "const uint32_t rom_dat[");
+	out_dec(ob, entries);
+	out_str(ob, "] = {");
+	for(size_t i = 0; i < entries; i++)
+	{
+		const uint32_t e = l->order[i];
+		const uint32_t cheat = ct->tot - 1 > CHEAT_LUT_MAX ?
+			0 : t->cheat[e];
+		const uint32_t ref = t->conf[e].reference ?
+			l->pos[ref_index[e]] : 0;
+
+		out_str(ob, i % 6 == 0 ? "\n\t0x" : " 0x");
+		out_hex(ob, conf_pack(&t->conf[e], ref, cheat), 8);
+		if(i != entries - 1)
+			out_str(ob, ",");
+	}
+	out_str(ob, "\n};\n");
+}
+
+/**
+ * Write the header. stamp is written in its first line, saying when or from
+ * what it was generated.
+ */
+void dump_header(const char *filename, const char *stamp,
+		const struct rom_table_s *t,
+		const uint32_t *ref_index, const struct layout_s *l,
+		const struct cheat_table_s *ct, const struct str_pool_s *sp,
+		const struct cheat_ops_s *co, int compact)
+{
+	const size_t entries = t->entries;
+	struct outbuf_s ob;
+	char *tmp;
+	FILE *f = open_output(filename, &tmp);
+	assert(f != NULL);
+
+	fprintf(f, "/* Generated %s using mupenini2dat */\n\n", stamp);
+	fprintf(f, "#pragma once\n");
+	fprintf(f, "#include <stddef.h>\n");
+	fprintf(f, "#include <stdint.h>\n\n");
+
+	if(compact)
+	{
+		dump_compact_macros(f);
+		goto save_types;
+	}
+
+	fprintf(f, "struct rom_entry_s\n"
+		"{\n"
+		"\tunion\n"
+		"\t{\n"
+		"\t\tstruct\n"
+		"\t\t{\n"
+		"\t\t\tunsigned char do_not_use : 1;\n"
+		"\t\t\tunsigned char save_type : 3;\n"
+		"\t\t\tunsigned char players : 3;\n"
+		"\t\t\tunsigned char rumble : 1;\n"
+		"\t\t\tunsigned char transferpak : 1;\n"
+		"\t\t\tunsigned char status : 3;\n"
+		"\t\t\tunsigned char count_per_op : 3;\n"
+		"\t\t\tunsigned char disable_extra_mem : 1;\n"
+		"\t\t\tunsigned char cheat_lut : 5;\n"
+		"\t\t\tunsigned char mempak : 1;\n"
+		"\t\t\tunsigned char biopak : 1;\n"
+		"\t\t\tunsigned char si_dma_duration : 1;\n"
+		"\t\t\tunsigned char ai_dma_modifier : 1;\n"
+		"\t\t\tunsigned char cheat_lut_hi : 7;\n"
+		"\t\t};\n"
+		"\t\tstruct\n"
+		"\t\t{\n"
+		"\t\t\tunsigned char reference : 1;\n"
+		"\t\t\tuint16_t reference_entry;\n"
+		"\t\t};\n"
+		"\t};\n"
+		"};\n\n");
+
+save_types:
+	fprintf(f, "enum save_types_e\n"
+		"{\n"
+		"\tSAVE_EEPROM_4KB = 0,\n"
+		"\tSAVE_EEPROM_16KB,\n"
+		"\tSAVE_SRAM,\n"
+		"\tSAVE_FLASH_RAM,\n"
+		"\tSAVE_CONTROLLER_PACK,\n"
+		"\tSAVE_NONE\n"
+		"};\n\n");
+
+	/* Align rom_crc[] so that each node of the B-tree is one cache
+	 * line. */
+	if(l->lookup == LOOKUP_BTREE)
+	{
+		fprintf(f, "#if defined(__GNUC__)\n"
+			"__attribute__((aligned(64)))\n"
+			"#endif\n");
+	}
+
+	out_init(&ob, f);
+	out_str(&ob, "const uint64_t rom_crc[");
+	out_dec(&ob, entries);
+	out_str(&ob, "] = {\n\t");
+	for(size_t i = 0; i < entries; i++)
+	{
+		if(i != 0 && i % 3 == 0)
+			out_str(&ob, "\n\t");
+		else if(i != 0)
+			out_str(&ob, " ");
+
+		out_str(&ob, "0x");
+		out_hex(&ob, t->crc[l->order[i]], 16);
+		if(i != entries - 1)
+			out_str(&ob, ",");
+	}
+	out_str(&ob, "\n};\n\n");
+
+	if(compact)
+	{
+		dump_compact(&ob, t, ref_index, l, ct);
+		goto lookup;
+	}
+
+	out_str(&ob, "const struct rom_entry_s rom_dat[");
+	out_dec(&ob, entries);
+	out_str(&ob, "] = {\n");
+	for(size_t i = 0; i < entries; i++)
+	{
+		const uint32_t e = l->order[i];
+		const union rom_conf_u *conf = &t->conf[e];
+		/* Too many cheats for the record are only in the side
+		 * table. */
+		const unsigned cheat = ct->tot - 1 > CHEAT_LUT_MAX ?
+			0 : t->cheat[e];
+
+		out_str(&ob, "\t/* ");
+		out_str(&ob, table_name(t, e));
+		out_str(&ob, "\n\t * CRC: ");
+		out_hex(&ob, t->crc[e] >> 32, 8);
+		out_str(&ob, " ");
+		out_hex(&ob, t->crc[e] & 0xFFFFFFFF, 8);
+		out_str(&ob, "\n\t * Entry: ");
+		out_dec(&ob, i);
+		out_str(&ob, " */\n\t{\n");
+
+		/* This entry refers to another. */
+		if(conf->reference == 1)
+		{
+			out_str(&ob, "\t\t.reference = 1,\n"
+					"\t\t.reference_entry = ");
+			out_dec(&ob, l->pos[ref_index[e]]);
+			out_str(&ob, i == (entries - 1) ? "\n\t}\n" : "\n\t},\n");
+			continue;
+		}
+
+		out_field(&ob, "status", conf->status);
+		out_str(&ob, "\t\t.save_type = ");
+		out_str(&ob, save_types_str[conf->save_type]);
+		out_str(&ob, ",\n");
+		out_field(&ob, "players", conf->players);
+		out_field(&ob, "rumble", conf->rumble);
+		out_field(&ob, "transferpak", conf->transferpak);
+		out_field(&ob, "mempak", conf->mempak);
+		out_field(&ob, "biopak", conf->biopak);
+		out_field(&ob, "count_per_op", conf->count_per_op);
+		out_field(&ob, "disable_extra_mem", conf->disable_extra_mem);
+		out_field(&ob, "si_dma_duration", conf->si_dma_duration);
+		out_field(&ob, "ai_dma_modifier", conf->ai_dma_modifier);
+		out_field(&ob, "cheat_lut", cheat & 0x1F);
+		if(cheat >> 5 != 0)
+			out_field(&ob, "cheat_lut_hi", cheat >> 5);
+		out_str(&ob, i == (entries - 1) ? "\t}\n" : "\t},\n");
+	}
+	out_str(&ob, "};\n");
+
+lookup:
+	out_free(&ob);
+
+	dump_lookup(f, l, compact);
+	dump_cheat_index(f, t, l, ct, compact, co != NULL);
+
+	if(sp != NULL)
+		dump_pool(f, sp, l);
+
+	if(co != NULL)
+	{
+		fprintf(f, "\n");
+		dump_cheat_ops(f, t, ct, co);
+		goto out;
+	}
+
+	if(ct->tot == 0)
+		goto out;
+
+	fprintf(f, "const char *const cheats[%zu] = {\n", ct->tot);
+	fprintf(f, "\t\"\",\n");
+	for(size_t i = 1; i < ct->tot; i++)
+	{
+		if(ct->first_user[i] != 0)
+		{
+			fprintf(f, "\n\t/**\n");
+			for(uint32_t u = ct->first_user[i]; u != 0;
+					u = ct->users[u].next)
+			{
+				fprintf(f, "\t * %s\n",
+					t->names.buf + ct->users[u].name);
+			}
+			fprintf(f, "\t */\n");
+		}
+
+		if(sp != NULL)
+		{
+			fprintf(f, "\trom_str_pool + %"PRIu32",\n",
+				sp->cheat[i]);
+			continue;
+		}
+
+		fprintf(f, "\t\"%s\",\n", cheat_text(ct, i));
+	}
+	fprintf(f, "};\n");
+
+out:
+	close_output(f, filename, tmp);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+	put_le32(p, (uint32_t)v);
+	put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+/**
+ * Write the table as a binary database that can be memory mapped and searched
+ * at runtime without parsing. The format is described in romdb.h.
+ * Returns 0 on success, or -1 if the table does not fit the format or the file
+ * cannot be written.
+ */
+int dump_binary(const char *filename, const struct rom_table_s *t,
+		const uint32_t *ref_index, const struct cheat_table_s *ct)
+{
+	const size_t entries = t->entries;
+	size_t crc_off, conf_off, cheat_off, pool_off, pool_len = 0, len;
+	uint8_t *buf, *p;
+	char *tmp;
+	FILE *f;
+
+	if(ct->tot - 1 > CHEAT_LUT_MAX)
+	{
+		fprintf(stderr, "ERR: %zu cheats do not fit in %s\n",
+				ct->tot - 1, filename);
+		return -1;
+	}
+
+	/* Entries are in table order, unlike in the header. */
+	if(check_refs(t, ref_index, NULL, filename) != 0)
+		return -1;
+
+	for(size_t i = 0; i < ct->tot; i++)
+		pool_len += (i == 0 ? 0 : ct->len[i]) + 1;
+
+	crc_off = ROMDB_HEADER_SIZE;
+	conf_off = crc_off + entries * 8;
+	cheat_off = conf_off + entries * 4;
+	pool_off = cheat_off + ct->tot * 4;
+	len = pool_off + pool_len;
+	assert(len <= UINT32_MAX);
+
+	buf = calloc(1, len);
+	assert(buf != NULL);
+
+	memcpy(buf, ROMDB_MAGIC, 8);
+	put_le32(buf + 8, ROMDB_VERSION);
+	put_le32(buf + 12, (uint32_t)entries);
+	put_le32(buf + 16, (uint32_t)ct->tot);
+	put_le32(buf + 20, (uint32_t)crc_off);
+	put_le32(buf + 24, (uint32_t)conf_off);
+	put_le32(buf + 28, (uint32_t)cheat_off);
+	put_le32(buf + 32, (uint32_t)pool_off);
+	put_le32(buf + 36, (uint32_t)pool_len);
+
+	for(size_t i = 0; i < entries; i++)
+	{
+		put_le64(buf + crc_off + i * 8, t->crc[i]);
+		put_le32(buf + conf_off + i * 4,
+				conf_pack(&t->conf[i], ref_index[i],
+					t->cheat[i]));
+	}
+
+	/* Cheat 0 is the empty string at the start of the pool. */
+	p = buf + pool_off + 1;
+	put_le32(buf + cheat_off, 0);
+	for(size_t i = 1; i < ct->tot; i++)
+	{
+		size_t slen = ct->len[i] + 1;
+
+		put_le32(buf + cheat_off + i * 4,
+				(uint32_t)(p - (buf + pool_off)));
+		memcpy(p, cheat_text(ct, i), slen);
+		p += slen;
+	}
+
+	f = open_output(filename, &tmp);
+	if(f == NULL)
+	{
+		free(buf);
+		return -1;
+	}
+
+	fwrite(buf, 1, len, f);
+	free(buf);
+	return close_output(f, filename, tmp);
+}
+
+/**
+ * Sort key of an entry. Only these are moved while sorting; the table is
+ * permuted once afterwards.
+ */
+struct sort_key_s
+{
+	uint64_t crc;
+	uint32_t reference;
+	uint32_t index;
+};
+
+/**
+ * Comparison of sort keys for qsort. Only used to check sort_keys() when
+ * benchmarking.
+ */
+int compare_entry(const void *in1, const void *in2)
+{
+	const struct sort_key_s *e1 = in1;
+	const struct sort_key_s *e2 = in2;
+
+	if(e1->crc != e2->crc)
+		return e1->crc < e2->crc ? -1 : 1;
+
+	if(e1->reference != e2->reference)
+		return ((int)e1->reference - (int)e2->reference);
+
+	/* Keep entries that compare equal in ini order. */
+	return (e1->index > e2->index) - (e1->index < e2->index);
+}
+
+/**
+ * Stable LSD radix sort of the keys by CRC, and then by reference. The first
+ * pass orders by the reference flag; each following pass orders by one byte of
+ * the CRC, starting with the least significant. Passes in which every key has
+ * the same digit are skipped.
+ * Keys with equal CRC and reference flag keep their relative order.
+ */
+void sort_keys(struct sort_key_s *keys, size_t entries)
+{
+	struct sort_key_s *tmp, *src = keys, *dst;
+	size_t count[8][256] = { { 0 } };
+	size_t refs = 0;
+
+	if(entries < 2)
+		return;
+
+	tmp = malloc(entries * sizeof(*tmp));
+	assert(tmp != NULL);
+	dst = tmp;
+
+	/* Obtain the histograms of all passes at once. */
+	for(size_t i = 0; i < entries; i++)
+	{
+		for(unsigned b = 0; b < 8; b++)
+			count[b][(keys[i].crc >> (b * 8)) & 0xFF]++;
+
+		refs += keys[i].reference != 0;
+	}
+
+	if(refs != 0 && refs != entries)
+	{
+		size_t pos[2] = { 0, entries - refs };
+
+		for(size_t i = 0; i < entries; i++)
+			dst[pos[src[i].reference != 0]++] = src[i];
+
+		src = tmp;
+		dst = keys;
+	}
+
+	for(unsigned b = 0; b < 8; b++)
+	{
+		size_t pos[256];
+		size_t sum = 0;
+		unsigned shift = b * 8;
+
+		if(count[b][(src[0].crc >> shift) & 0xFF] == entries)
+			continue;
+
+		for(unsigned d = 0; d < 256; d++)
+		{
+			pos[d] = sum;
+			sum += count[b][d];
+		}
+
+		for(size_t i = 0; i < entries; i++)
+			dst[pos[(src[i].crc >> shift) & 0xFF]++] = src[i];
+
+		/* Swap buffers. */
+		{
+			struct sort_key_s *swap = src;
+			src = dst;
+			dst = swap;
+		}
+	}
+
+	if(src != keys)
+		memcpy(keys, src, entries * sizeof(*keys));
+
+	free(tmp);
+}
+
+/**
+ * Reorder an array of entries so that element i is the element previously at
+ * keys[i].index. Returns the new array, which replaces arr.
+ */
+static void *permute(struct arena_s *arena, void *arr, size_t size,
+		const struct sort_key_s *keys, size_t entries)
+{
+	unsigned char *out = mem_alloc(arena, (entries + 1) * size);
+	const unsigned char *in = arr;
+
+	for(size_t i = 0; i < entries; i++)
+		memcpy(out + i * size, in + keys[i].index * size, size);
+
+	mem_free(arena, arr);
+	return out;
+}
+
+/**
+ * Sort the table by CRC, with entries that do not refer to another entry
+ * first.
+ */
+void sort_table(struct rom_table_s *t)
+{
+	struct sort_key_s *keys = malloc((t->entries + 1) * sizeof(*keys));
+
+	assert(keys != NULL);
+
+	for(size_t i = 0; i < t->entries; i++)
+	{
+		keys[i].crc = t->crc[i];
+		keys[i].reference = t->conf[i].reference;
+		keys[i].index = (uint32_t)i;
+	}
+
+	sort_keys(keys, t->entries);
+
+	t->crc = permute(t->arena, t->crc, sizeof(*t->crc), keys,
+			t->entries);
+	t->conf = permute(t->arena, t->conf, sizeof(*t->conf), keys,
+			t->entries);
+	t->md5 = permute(t->arena, t->md5, sizeof(*t->md5), keys,
+			t->entries);
+	t->refmd5 = permute(t->arena, t->refmd5, sizeof(*t->refmd5), keys,
+			t->entries);
+	t->refcrc = permute(t->arena, t->refcrc, sizeof(*t->refcrc), keys,
+			t->entries);
+	t->name = permute(t->arena, t->name, sizeof(*t->name), keys,
+			t->entries);
+	t->cheat = permute(t->arena, t->cheat, sizeof(*t->cheat), keys,
+			t->entries);
+
+	free(keys);
+}
+
+/**
+ * Whether an entry may be left out of the table, as every value it has is the
+ * default that the emulator assumes for unknown ROMs.
+ */
+static int conf_is_default(const union rom_conf_u *c)
+{
+	return c->status == 0 && c->save_type == SAVE_NONE &&
+		c->players == 4 && c->rumble == 1 &&
+		c->transferpak == 0 && c->mempak == 1 &&
+		c->biopak == 0 && c->count_per_op == 2 &&
+		c->disable_extra_mem == 0 &&
+		c->si_dma_duration == 0 && c->reference == 1;
+}
+
+/**
+ * Remove entries with duplicate CRCs, and entries that only use defaults, in a
+ * single pass over the sorted table. The table is compacted in place.
+ */
+void remove_dupes(struct rom_table_s *t)
+{
+	size_t out = 0;
+
+	for(size_t i = 0; i < t->entries; i++)
+	{
+		/* Keep the first entry of each CRC. After sorting, that is an
+		 * entry which does not refer to another, if there is one. */
+		size_t keep = i;
+
+		while(i + 1 < t->entries && t->crc[i + 1] == t->crc[keep])
+			i++;
+
+		if(!conf_is_default(&t->conf[keep]))
+			table_move(t, out++, keep);
+	}
+
+	t->entries = out;
+}
+
+void dump_filtered_ini(const struct rom_table_s *t)
+{
+	FILE *f = fopen("fil.ini", "w");
+	char hex[33];
+
+	assert(f != NULL);
+
+	for(size_t i = 0; i < t->entries; i++)
+	{
+		fprintf(f, "[%s]\n", md5_to_hex(hex, t->md5[i]));
+		fprintf(f, "GoodName=%s\n", table_name(t, i));
+		fprintf(f, "CRC=0x%016"PRIX64"\n", t->crc[i]);
+		if(t->conf[i].reference)
+			fprintf(f, "RefMD5=%s\n", md5_to_hex(hex, t->refmd5[i]));
+
+		fprintf(f, "\n");
+	}
+
+	fclose(f);
+}
+
+/**
+ * Resolve the RefMD5 of each entry to the index of the entry it refers to.
+ * Chains of references are followed to the final entry that holds the
+ * configuration. References to a missing entry, or that form a cycle, are
+ * reported and dropped; such entries then use their own configuration.
+ */
+void resolve_deps(struct rom_table_s *t)
+{
+	const size_t entries = t->entries;
+	struct md5_map_s map;
+	uint32_t *target, *resolved;
+	char hex[33];
+
+	/* Direct and final target of each reference, or MD5_MAP_EMPTY. */
+	target = malloc((entries + 1) * sizeof(*target));
+	resolved = malloc((entries + 1) * sizeof(*resolved));
+	assert(target != NULL && resolved != NULL);
+	md5_map_init(&map, entries);
+
+	for(size_t i = 0; i < entries; i++)
+		md5_map_insert(&map, t->md5[i], (uint32_t)i);
+
+	for(size_t i = 0; i < entries; i++)
+	{
+		target[i] = MD5_MAP_EMPTY;
+		if(t->conf[i].reference == 0)
+			continue;
+
+		target[i] = md5_map_find(&map, t->refmd5[i]);
+		if(target[i] == MD5_MAP_EMPTY)
+		{
+			fprintf(stderr, "WARNING: %s refers to missing entry "
+					"%s\n", table_name(t, i),
+					md5_to_hex(hex, t->refmd5[i]));
+		}
+	}
+
+	/* Follow chains using the direct targets first, so that every
+	 * entry of a cycle is reported before any reference is dropped. */
+	for(size_t i = 0; i < entries; i++)
+	{
+		uint32_t r = target[i];
+		size_t steps = 0;
+
+		if(t->conf[i].reference == 0)
+			continue;
+
+		/* An acyclic chain cannot be longer than the number of
+		 * entries. */
+		while(r != MD5_MAP_EMPTY && t->conf[r].reference != 0 &&
+				steps++ < entries)
+		{
+			r = target[r];
+		}
+
+		if(r != MD5_MAP_EMPTY && t->conf[r].reference != 0)
+		{
+			fprintf(stderr, "WARNING: %s is part of a cyclic "
+					"reference\n", table_name(t, i));
+			r = MD5_MAP_EMPTY;
+		}
+
+		resolved[i] = r;
+	}
+
+	for(size_t i = 0; i < entries; i++)
+	{
+		if(t->conf[i].reference == 0)
+			continue;
+
+		if(resolved[i] == MD5_MAP_EMPTY)
+		{
+			t->conf[i].reference = 0;
+			continue;
+		}
+
+		/* The index written out is found by CRC in remap_refs()
+		 * once duplicates are removed, and checked by check_refs().
+		 * This one is only stored as conf_is_default() sees it
+		 * through the union. */
+		t->conf[i].reference_entry = (uint16_t)resolved[i];
+		t->refcrc[i] = t->crc[resolved[i]];
+	}
+
+	md5_map_free(&map);
+	free(resolved);
+	free(target);
+}
+
+/**
+ * Map the reference of each entry to the index of the referenced entry in the
+ * final table. Entries must be sorted by CRC and free of duplicates, so that
+ * each target is found by binary search. References whose target is no longer
+ * in the table are dropped.
+ * Returns an array holding the target index of each reference entry.
+ */
+uint32_t *remap_refs(struct rom_table_s *t)
+{
+	const size_t entries = t->entries;
+	uint32_t *ref_index = calloc(entries + 1, sizeof(*ref_index));
+
+	assert(ref_index != NULL);
+
+	for(size_t i = 0; i < entries; i++)
+	{
+		size_t lo = 0, hi = entries;
+
+		if(t->conf[i].reference == 0)
+			continue;
+
+		while(lo < hi)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+
+			if(t->crc[mid] < t->refcrc[i])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if(lo == entries || t->crc[lo] != t->refcrc[i])
+		{
+			fprintf(stderr, "WARNING: Target of %s was removed\n",
+					table_name(t, i));
+			t->conf[i].reference = 0;
+			continue;
+		}
+
+		ref_index[i] = (uint32_t)lo;
+	}
+
+	return ref_index;
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Time scanning and conversion of the ini over a number of runs, reporting the
+ * throughput of each stage in lines per second.
+ */
+static void bench_parse(const struct ini_map_s *ini, unsigned runs,
+		unsigned jobs)
+{
+	double scan = 0.0, conv = 0.0;
+	size_t lines = 0;
+
+	for(unsigned r = 0; r < runs; r++)
+	{
+		struct ini_index_s idx;
+		struct rom_table_s table;
+		struct cheat_table_s cheats = { .tot = 1 };
+		double t0, t1, t2;
+
+		t0 = now_sec();
+		ini_scan(ini->buf, ini->len, &idx, NULL);
+		t1 = now_sec();
+		convert_entries(ini->buf, &idx, jobs, &table, &cheats, NULL,
+				NULL);
+		t2 = now_sec();
+
+		scan += t1 - t0;
+		conv += t2 - t1;
+		lines = idx.nlines;
+
+		table_free(&table);
+		free_cheats(&cheats);
+		ini_index_free(&idx);
+	}
+
+	printf("Benchmark: %u runs of %zu lines with %u jobs\n", runs, lines,
+			jobs);
+	printf("  scan:    %12.0f lines/s\n",
+			(double)lines * runs / (scan > 0.0 ? scan : 1e-9));
+	printf("  convert: %12.0f lines/s\n",
+			(double)lines * runs / (conv > 0.0 ? conv : 1e-9));
+}
+
+static uint64_t xorshift64(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+/**
+ * Compare sort_keys() against qsort() on synthetic catalogues of increasing
+ * size, reporting the time taken per sort.
+ */
+static void bench_sort(void)
+{
+	const size_t sizes[] = { 3000, 100000, 1000000 };
+	uint64_t state = UINT64_C(0x853C49E6748FEA9B);
+
+	printf("Benchmark: sorting\n");
+
+	for(unsigned s = 0; s < sizeof(sizes) / sizeof(*sizes); s++)
+	{
+		const size_t n = sizes[s];
+		/* Repeat small sorts so that each size takes similar time. */
+		const unsigned reps = (unsigned)(3000000 / n);
+		struct sort_key_s *orig = malloc(n * sizeof(*orig));
+		struct sort_key_s *a = malloc(n * sizeof(*a));
+		struct sort_key_s *b = malloc(n * sizeof(*b));
+		double t_qsort = 0.0, t_radix = 0.0;
+
+		assert(orig != NULL && a != NULL && b != NULL);
+
+		/* Like the ini, about a third of the entries are references,
+		 * and some CRCs are repeated. */
+		for(size_t i = 0; i < n; i++)
+		{
+			uint64_t r = xorshift64(&state);
+
+			orig[i].crc = (i != 0 && r % 8 == 0) ?
+				orig[i - 1].crc : xorshift64(&state);
+			orig[i].reference = (r >> 8) % 3 == 0;
+			orig[i].index = (uint32_t)i;
+		}
 
-	if(f == NULL)
-	{
-		PRINTERR();
-		goto out;
-	}
+		for(unsigned r = 0; r < reps; r++)
+		{
+			double t0;
 
-	fseek(f, 0, SEEK_END);
-	fsz = ftell(f);
-	fseek(f, 0, SEEK_SET);
+			memcpy(a, orig, n * sizeof(*a));
+			memcpy(b, orig, n * sizeof(*b));
 
-	ini = malloc(fsz + 1);
-	if(ini == NULL)
-	{
-		PRINTERR();
-		fclose(f);
-		goto out;
-	}
+			t0 = now_sec();
+			qsort(a, n, sizeof(*a), compare_entry);
+			t_qsort += now_sec() - t0;
 
-	fread(ini, 1, fsz, f);
-	fclose(f);
+			t0 = now_sec();
+			sort_keys(b, n);
+			t_radix += now_sec() - t0;
+		}
 
-	ini[fsz] = '\0';
+		assert(memcmp(a, b, n * sizeof(*a)) == 0);
+		printf("  %7zu entries: qsort %10.1f us, radix %10.1f us\n",
+				n, t_qsort * 1e6 / reps, t_radix * 1e6 / reps);
 
-out:
-	return ini;
+		free(orig);
+		free(a);
+		free(b);
+	}
 }
 
 /**
- * Determine number of entries in ini by searching for occurrences of "\n[".
+ * Time writing the header, which is rewritten on every run with the same
+ * contents.
  */
-static size_t get_num_entries(char *haystack)
+static void bench_dump(const char *filename, const char *stamp,
+		const struct rom_table_s *t,
+		const uint32_t *ref_index, const struct layout_s *l,
+		const struct cheat_table_s *ct, const struct str_pool_s *sp,
+		const struct cheat_ops_s *co, int compact, unsigned runs)
 {
-	size_t entries = 0;
-	char *str = haystack;
+	struct stat st;
+	double t0, secs;
 
-	while((str = strstr(str, "\n[")) != NULL)
+	t0 = now_sec();
+	for(unsigned r = 0; r < runs; r++)
+		dump_header(filename, stamp, t, ref_index, l, ct, sp, co,
+				compact);
+	secs = now_sec() - t0;
+
+	if(stat(filename, &st) != 0)
 	{
-		entries++;
-		str++;
+		PRINTERR();
+		return;
 	}
 
-	return entries;
+	printf("Benchmark: writing %zu entries, %u runs\n", t->entries, runs);
+	printf("  dump:    %12.0f entries/s, %.1f MiB/s\n",
+			(double)(t->entries * runs) / secs,
+			(double)st.st_size * runs / secs / (1024 * 1024));
 }
 
-struct rom_entry_s *convert_entries(const char *ini,
-                                    const size_t entries)
+/**
+ * Compare lookups per second of binary search over the sorted CRCs against the
+ * searches emitted for each --lookup layout: Eytzinger, minimal perfect hash,
+ * B-tree and split CRC1 index, using the final table.
+ */
+static void bench_lookup(const struct rom_table_s *t)
 {
-#define strncmplim(hay, needle) memcmp(hay, needle, sizeof(needle)-1)
-	struct rom_entry_s *dat = calloc(entries + 1, sizeof(struct rom_entry_s));
-	struct rom_entry_s *entry = dat;
-	int first = 1;
-	const char *line = ini;
+	const size_t n = t->entries;
+	const unsigned lookups = 4000000;
+	struct layout_s l, m, bt, sp;
+	uint64_t *eyt, *mph, *btr, *queries;
+	uint64_t state = UINT64_C(0x2545F4914F6CDD1D);
+	double t0, t_bin, t_eyt, t_mph, t_btr, t_spl;
+	size_t found_bin = 0, found_eyt = 0, found_mph = 0, found_btr = 0;
+	size_t found_spl = 0;
+
+	if(n == 0)
+		return;
 
-	assert(dat != NULL);
+	compute_layout(t, LOOKUP_EYTZINGER, &l);
+	compute_layout(t, LOOKUP_MPHF, &m);
+	compute_layout(t, LOOKUP_BTREE, &bt);
+	compute_layout(t, LOOKUP_SPLIT, &sp);
+	eyt = malloc(n * sizeof(*eyt));
+	mph = malloc(n * sizeof(*mph));
+	btr = malloc(n * sizeof(*btr));
+	queries = malloc(lookups * sizeof(*queries));
+	assert(eyt != NULL && mph != NULL && btr != NULL && queries != NULL);
 
-	while((line = strchr(line, '\n')) != NULL)
+	for(size_t i = 0; i < n; i++)
 	{
-		line++;
+		eyt[i] = t->crc[l.order[i]];
+		mph[i] = t->crc[m.order[i]];
+		btr[i] = t->crc[bt.order[i]];
+	}
 
-		/* Skip if empty line. */
-		if(*line == '\n')
-			continue;
-		/* Skip if comment. */
-		else if(*line == ';')
-			continue;
-		else if(strncmplim(line, "[") == 0)
-		{
-			/* New entry. */
-			/* Compensate for 0-based indexing. */
-			if(first)
-				first = 0;
-			else
-			{
-				/* Set to new entry. */
-				entry++;
-			}
+	/* Half of the queries are for ROMs in the table. */
+	for(unsigned q = 0; q < lookups; q++)
+	{
+		uint64_t r = xorshift64(&state);
+		queries[q] = (r & 1) ? t->crc[(r >> 1) % n] : xorshift64(&state);
+	}
 
-			line++;
-			memcpy(entry->track.md5, line, 32);
-			entry->track.md5[32] = '\0';
-		}
-		else if(strncmplim(line, "CRC") == 0)
-		{
-			uint32_t c1, c2;
-			char *endptr;
+	t0 = now_sec();
+	for(unsigned q = 0; q < lookups; q++)
+	{
+		size_t lo = 0, hi = n;
 
-			/* Move to first character after equals. */
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
+		while(lo < hi)
+		{
+			size_t mid = lo + (hi - lo) / 2;
 
-			c1 = strtoul(line, &endptr, 16);
-			assert(*endptr == ' ');
+			if(t->crc[mid] < queries[q])
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
 
-			/* Move to second CRC. */
-			line = endptr;
+		found_bin += (lo < n && t->crc[lo] == queries[q]);
+	}
+	t_bin = now_sec() - t0;
 
-			c2 = strtoul(line, &endptr, 16);
-			assert(*endptr == '\n');
-			entry->crc = ((uint64_t)c1 << 32) | c2;
+	t0 = now_sec();
+	for(unsigned q = 0; q < lookups; q++)
+	{
+		size_t k = 1;
 
-			/* Init variables to default values. */
-			entry->conf.status = 0;
-			entry->conf.save_type = 5;
-			entry->conf.players = 4;
-			entry->conf.rumble = 1;
-			entry->conf.transferpak = 0;
-			entry->conf.mempak = 1;
-			entry->conf.biopak = 0;
-			entry->conf.count_per_op = 2;
-			entry->conf.disable_extra_mem = 0;
-			entry->conf.si_dma_duration = 0;
-			entry->conf.ai_dma_modifier = 0;
-		}
-		else if(strncmplim(line, "RefMD5") == 0)
+		while(k <= n)
 		{
-			line = strchr(line, '=') + 1;
-			entry->conf.reference = 1;
-			memcpy(entry->track.refmd5, line, 32);
-			entry->track.refmd5[32] = '\0';
-
-			/* TODO: Find reference. */
+			__builtin_prefetch(eyt + 16 * k - 1);
+			k = 2 * k + (eyt[k - 1] < queries[q]);
 		}
-		else if(strncmplim(line, "SaveType") == 0)
-		{
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
 
-			switch(*line)
-			{
-			case 'E':
-				if(*(line + strlen("Eeprom ")) == '4')
-					entry->conf.save_type = SAVE_EEPROM_4KB;
-				else if(*(line + strlen("Eeprom ")) == '1')
-					entry->conf.save_type = SAVE_EEPROM_16KB;
-				else
-					abort();
-				break;
-			case 'S':
-				entry->conf.save_type = SAVE_SRAM;
-				break;
+		k >>= __builtin_ffsll((long long)~k);
+		found_eyt += (k != 0 && eyt[k - 1] == queries[q]);
+	}
+	t_eyt = now_sec() - t0;
 
-			case 'F':
-				entry->conf.save_type = SAVE_FLASH_RAM;
-				break;
+	t0 = now_sec();
+	for(unsigned q = 0; q < lookups; q++)
+	{
+		uint32_t b = mphf_bucket(queries[q], m.buckets);
+		uint32_t slot = mphf_slot(queries[q], m.seed[b], (uint32_t)n);
 
-			case 'C':
-				entry->conf.save_type = SAVE_CONTROLLER_PACK;
-				break;
+		found_mph += (mph[slot] == queries[q]);
+	}
+	t_mph = now_sec() - t0;
 
-			case 'N':
-				entry->conf.save_type = SAVE_NONE;
-				break;
+	/* The same search as the header writes, with the portable rank. */
+	t0 = now_sec();
+	for(unsigned q = 0; q < lookups; q++)
+	{
+		size_t k = 0, found = n;
 
-			default:
-				abort();
-			}
-		}
-		else if(strncmplim(line, "Status") == 0)
+		while(BTREE_KEYS * k < n)
 		{
-			char *endptr;
-			unsigned status;
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
+			const size_t base = BTREE_KEYS * k;
+			size_t i = 0;
 
-			status = strtoul(line, &endptr, 10);
-			assert(*endptr == '\n');
-			assert(status < 6);
-			entry->conf.status = status & 0x7;
-		}
-		else if(strncmplim(line, "Players") == 0)
-		{
-			char *endptr;
-			unsigned players;
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
+			while(i < BTREE_KEYS && base + i < n &&
+					btr[base + i] < queries[q])
+				i++;
 
-			players = strtoul(line, &endptr, 10);
-			assert(*endptr == '\n');
-			assert(players < 8);
-			entry->conf.players = players & 0x7;
-		}
-		else if(strncmplim(line, "Rumble") == 0)
-		{
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
-			entry->conf.rumble = (*line == 'Y');
-		}
-		else if(strncmplim(line, "CountPerOp") == 0)
-		{
-			char *endptr;
-			unsigned count_per_op;
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
+			if(i < BTREE_KEYS && base + i < n)
+				found = base + i;
 
-			count_per_op = strtoul(line, &endptr, 10);
-			assert(*endptr == '\n');
-			assert(count_per_op <= 4);
-			entry->conf.count_per_op = count_per_op & 0x7;
-		}
-		else if(strncmplim(line, "DisableExtraMem") == 0)
-		{
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
-			entry->conf.count_per_op = (*line == '1');
+			k = (BTREE_KEYS + 1) * k + i + 1;
 		}
-		else if(strncmplim(line, "Cheat0") == 0)
-		{
-			uint8_t cheat_found = 0;
-			char *endline = strchr(line, '\n');
-			size_t len;
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
-
-			len = endline - line;
-			len++; /* For null char. */
-
-			for(size_t ci = 1; ci < cheats_tot; ci++)
-			{
-				if(memcmp(cheats[ci], line, len - 1) == 0)
-				{
-					char *tmp;
-					asprintf(&tmp, "%s\t * %s\n",
-					         cheats_used_by[ci] == NULL ? "" :
-							cheats_used_by[ci],
-					         entry->track.goodname);
-					free(cheats_used_by[ci]);
-					cheats_used_by[ci] = tmp;
-					cheat_found = ci;
-					break;
-				}
-			}
 
-			if(cheat_found)
-			{
-				entry->conf.cheat_lut = cheat_found;
-				fprintf(stderr, "DEBUG: Cheat for %s found in"
-						" entry %d\n",
-						entry->track.goodname,
-						cheat_found);
-				continue;
-			}
+		found_btr += (found < n && btr[found] == queries[q]);
+	}
+	t_btr = now_sec() - t0;
 
-			cheats[cheats_tot] = malloc(len);
-			assert(cheats[cheats_tot] != NULL);
-			memcpy(cheats[cheats_tot], line, len);
-			cheats[cheats_tot][len - 1] = '\0';
-			entry->conf.cheat_lut = cheats_tot;
-			asprintf(&cheats_used_by[cheats_tot], "\t * %s\n",
-					         entry->track.goodname);
+	t0 = now_sec();
+	for(unsigned q = 0; q < lookups; q++)
+	{
+		const uint32_t c1 = (uint32_t)(queries[q] >> 32);
+		uint32_t lo = 0, hi = sp.crc1_n, e;
 
-			fprintf(stderr, "DEBUG: Cheat %lld added for %s\n",
-					cheats_tot, entry->track.goodname);
-			cheats_tot++;
-		}
-		else if(strncmplim(line, "Transferpak") == 0)
-		{
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
-			entry->conf.transferpak = (*line == 'Y');
-		}
-		else if(strncmplim(line, "Mempak") == 0)
-		{
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
-			entry->conf.biopak = (*line == 'Y');
-		}
-		else if(strncmplim(line, "Biopak") == 0)
+		while(lo < hi)
 		{
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
-			entry->conf.biopak = (*line == 'Y');
+			uint32_t mid = lo + (hi - lo) / 2;
+
+			if(sp.crc1[mid] < c1)
+				lo = mid + 1;
+			else
+				hi = mid;
 		}
-		else if(strncmplim(line, "SiDmaDuration") == 0)
+
+		if(lo == sp.crc1_n || sp.crc1[lo] != c1)
+			continue;
+
+		e = sp.crc1_entry[lo];
+		if((e & SPLIT_COLLISION) == 0)
 		{
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
-			assert(*line == '1');
-			entry->conf.si_dma_duration = 1;
+			found_spl += t->crc[e] == queries[q];
+			continue;
 		}
-		else if(strncmplim(line, "AiDmaModifier") == 0)
+
+		for(e &= ~SPLIT_COLLISION;; e++)
 		{
-			unsigned dma_mod;
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
-			dma_mod = strtoul(line, NULL, 10);
-			if(dma_mod == 88)
-				entry->conf.ai_dma_modifier = 1;
-			else
+			if(sp.coll_crc2[e] == (uint32_t)queries[q])
 			{
-				fprintf(stderr, "WARNING: AiDmaModifier of %ul "
-						"is not supported\n",
-						dma_mod);
+				found_spl++;
+				break;
 			}
-		}
-		else if(strncmplim(line, "GoodName") == 0)
-		{
-			char *endline = strchr(line, '\n');
-			size_t len;
-			line = strchr(line, '=');
-			assert(line != NULL);
-			line++;
 
-			len = endline - line;
-			if(len >= 64)
-				len = 63;
-
-			assert(entry->track.goodname != NULL);
-			memcpy(entry->track.goodname, line, len);
-			entry->track.goodname[len] = '\0';
-		}
-		else if(*line != '\0')
-		{
-			char *endline = strchr(line, '\n');
-			int len = endline - line;
-			fprintf(stderr, "WARNING: Unknown key '%.*s'\n",
-					len, line);
+			if(sp.coll_entry[e] & SPLIT_LAST)
+				break;
 		}
 	}
+	t_spl = now_sec() - t0;
 
-	/* All entries begin with a CRC value. */
-	return dat;
+	assert(found_bin == found_eyt && found_bin == found_mph &&
+			found_bin == found_btr && found_bin == found_spl);
+	printf("Benchmark: %u lookups in %zu entries\n", lookups, n);
+	printf("  sorted:    %12.0f lookups/s\n", lookups / t_bin);
+	printf("  eytzinger: %12.0f lookups/s\n", lookups / t_eyt);
+	printf("  mphf:      %12.0f lookups/s (%"PRIu32" seeds, max %"PRIu32")\n",
+			lookups / t_mph, m.buckets, m.max_seed);
+	printf("  btree:     %12.0f lookups/s\n", lookups / t_btr);
+	printf("  split:     %12.0f lookups/s\n", lookups / t_spl);
+
+	free(queries);
+	free(btr);
+	free(mph);
+	free(eyt);
+	free_layout(&sp);
+	free_layout(&bt);
+	free_layout(&m);
+	free_layout(&l);
 }
 
-void dump_header(const char *filename, struct rom_entry_s *e, size_t entries)
+/**
+ * Describe when the header was generated. The time is taken from
+ * SOURCE_DATE_EPOCH if it is set, so that builds are reproducible. Otherwise if
+ * reproducible is set, the hash of the ini and options is given instead of a
+ * time, so that the header only changes with its contents.
+ */
+static void make_stamp(char *buf, size_t size, int reproducible,
+		uint64_t content)
 {
-	FILE *f = fopen(filename, "wb");
+	const char *epoch = getenv("SOURCE_DATE_EPOCH");
 	time_t now = time(NULL);
-	struct tm *tmp;
-	char time_str[128];
-	assert(f != NULL);
-
-	tmp = localtime(&now);
-	assert(tmp != NULL);
-
-	assert(strftime(time_str, sizeof(time_str), "%c", tmp) != 0);
-
-	fprintf(f, "/* Generated at %s using mupenini2dat */\n\n", time_str);
-	fprintf(f, "#pragma once\n");
-	fprintf(f, "#include <stdint.h>\n\n");
-
-	fprintf(f, "struct rom_entry_s\n"
-		"{\n"
-		"\tunion\n"
-		"\t{\n"
-		"\t\tstruct\n"
-		"\t\t{\n"
-		"\t\t\tunsigned char do_not_use : 1;\n"
-		"\t\t\tunsigned char save_type : 3;\n"
-		"\t\t\tunsigned char players : 3;\n"
-		"\t\t\tunsigned char rumble : 1;\n"
-		"\t\t\tunsigned char transferpak : 1;\n"
-		"\t\t\tunsigned char status : 3;\n"
-		"\t\t\tunsigned char count_per_op : 3;\n"
-		"\t\t\tunsigned char disable_extra_mem : 1;\n"
-		"\t\t\tunsigned char cheat_lut : 5;\n"
-		"\t\t\tunsigned char mempak : 1;\n"
-		"\t\t\tunsigned char biopak : 1;\n"
-		"\t\t\tunsigned char si_dma_duration : 1;\n"
-		"\t\t\tunsigned char ai_dma_modifier : 1;\n"
-		"\t\t};\n"
-		"\t\tstruct\n"
-		"\t\t{\n"
-		"\t\t\tunsigned char reference : 1;\n"
-		"\t\t\tuint16_t reference_entry;\n"
-		"\t\t};\n"
-		"\t};\n"
-		"};\n\n");
-
-	fprintf(f, "enum save_types_e\n"
-		"{\n"
-		"\tSAVE_EEPROM_4KB = 0,\n"
-		"\tSAVE_EEPROM_16KB,\n"
-		"\tSAVE_SRAM,\n"
-		"\tSAVE_FLASH_RAM,\n"
-		"\tSAVE_CONTROLLER_PACK,\n"
-		"\tSAVE_NONE\n"
-		"};\n\n");
+	struct tm *tm;
 
-	fprintf(f, "const uint64_t rom_crc[%zu] = {\n\t", entries);
-	for(size_t i = 0; i < entries; i++)
+	if(epoch != NULL && *epoch != '\0')
 	{
-		if(i != 0 && i % 3 == 0)
-		{
-			fprintf(f, "\n\t");
-		}
-		else if(i != 0)
+		char *end;
+		unsigned long long v;
+
+		errno = 0;
+		v = strtoull(epoch, &end, 10);
+		if(*end == '\0' && errno == 0)
 		{
-			fprintf(f, " ");
+			now = (time_t)v;
+			tm = gmtime(&now);
+			goto format;
 		}
 
-		fprintf(f, "0x%016"PRIX64"%s", e[i].crc,
-		        i == (entries - 1) ? "" : ",");
+		fprintf(stderr, "WARNING: Invalid SOURCE_DATE_EPOCH '%s'\n",
+				epoch);
 	}
-	fprintf(f, "\n};\n\n");
 
-	fprintf(f, "const struct rom_entry_s rom_dat[%zu] = {\n", entries);
-	struct rom_entry_s *last = e + entries;
-	for(struct rom_entry_s *i = e; i < last; i++)
+	if(reproducible)
 	{
-		fprintf(f, "\t/* %s\n", i->track.goodname);
-		fprintf(f, "\t * CRC: %08"PRIX32" %08"PRIX32"\n",
-				(uint32_t)(i->crc >> 32),
-				(uint32_t)(i->crc & 0xFFFFFFFF));
-		fprintf(f, "\t * Entry: %zu */\n", i - e);
-		fprintf(f, "\t{\n");
-
-		/* This entry refers to another. */
-		if(i->conf.reference == 1)
-		{
-			unsigned ref_i;
-			for(ref_i = 0; ref_i < entries; ref_i++)
-			{
-				if(i->track.refcrc == e[ref_i].crc)
-					break;
-			}
+		snprintf(buf, size, "from ini %016"PRIX64, content);
+		return;
+	}
 
-			/* Check if reference actually exists. If it doesn't, it
-			 * probably used default values. */
-			if(i->track.refcrc != e[ref_i].crc)
-				continue;
+	tm = localtime(&now);
 
-			fprintf(f, "\t\t.reference = %u,\n", i->conf.reference);
-			fprintf(f, "\t\t.reference_entry = %u\n", ref_i);
-			fprintf(f, "\t}%s\n", i == (last - 1) ? "" : ",");
-			continue;
-		}
+format:
+	assert(size > 3);
+	strcpy(buf, "at ");
 
-		fprintf(f, "\t\t.status = %u,\n", i->conf.status);
-		fprintf(f, "\t\t.save_type = %s,\n", save_types_str[i->conf.save_type]);
-		fprintf(f, "\t\t.players = %u,\n", i->conf.players);
-		fprintf(f, "\t\t.rumble = %u,\n", i->conf.rumble);
-		fprintf(f, "\t\t.transferpak = %u,\n", i->conf.transferpak);
-		fprintf(f, "\t\t.mempak = %u,\n", i->conf.mempak);
-		fprintf(f, "\t\t.biopak = %u,\n", i->conf.biopak);
-		fprintf(f, "\t\t.count_per_op = %u,\n", i->conf.count_per_op);
-		fprintf(f, "\t\t.disable_extra_mem = %u,\n", i->conf.disable_extra_mem);
-		fprintf(f, "\t\t.si_dma_duration = %u,\n", i->conf.si_dma_duration);
-		fprintf(f, "\t\t.ai_dma_modifier = %u,\n", i->conf.ai_dma_modifier);
-		fprintf(f, "\t\t.cheat_lut = %u,\n", i->conf.cheat_lut);
-		fprintf(f, "\t}%s\n", i == (last - 1) ? "" : ",");
+	/* The time may not be representable, or not fit. */
+	if(tm == NULL || strftime(buf + 3, size - 3, "%c", tm) == 0)
+	{
+		snprintf(buf, size, "at %lld seconds since the epoch",
+				(long long)now);
 	}
-	fprintf(f, "};\n");
+}
 
-	if(cheats_tot == 0)
-		goto out;
+/**
+ * Convert an ini that is read from a pipe, or standard input if filename is
+ * "-", allocating from arena. The lines of the ini are hashed onto content, as
+ * by hash_lines().
+ * Returns 0 on success, or -1 on error.
+ */
+static int read_stream(const char *filename, struct rom_table_s *t,
+		struct cheat_table_s *ct, struct arena_s *arena,
+		uint64_t *content)
+{
+	const int use_stdin = strcmp(filename, "-") == 0;
+	int fd = use_stdin ? STDIN_FILENO : open(filename, O_RDONLY);
+	int ret;
 
-	fprintf(f, "const char *const cheats[%zu] = {\n", cheats_tot);
-	fprintf(f, "\t\"\",\n");
-	for(size_t i = 1; i < cheats_tot; i++)
+	if(fd < 0)
 	{
-		if(cheats_used_by[i] != NULL)
-		{
-			fprintf(f, "%s\t/**\n%s\t */\n", i == 0 ? "" : "\n",
-				cheats_used_by[i]);
-		}
+		PRINTERR();
+		return -1;
+	}
 
-		fprintf(f, "\t\"%s\"%s\n", cheats[i],
-			i == (entries - 1) ? "" : ",");
+	ret = convert_stream(fd, t, ct, arena, content);
+	if(!use_stdin)
+		close(fd);
+
+	if(ret != 0)
+	{
+		free_cheats(ct);
+		table_free(t);
+		return -1;
 	}
-	fprintf(f, "};\n");
 
-out:
-	fclose(f);
+	printf("Processed %zu entries\n", t->entries);
+	return 0;
 }
 
-int compare_entry(const void *in1, const void *in2)
+int main(int argc, char *argv[])
 {
-	const struct rom_entry_s *e1 = in1;
-	const struct rom_entry_s *e2 = in2;
+	struct ini_map_s ini;
+	struct ini_index_s idx;
+	struct rom_table_s table;
+	uint32_t *ref_index;
+	struct cheat_table_s cheats = { .tot = 1 };
+	struct layout_s layout;
+	struct str_pool_s pool;
+	int names = 0;
+	struct cheat_ops_s ops;
+	int cheat_ops = 0;
+	int compact = 0;
+	enum lookup_e lookup = LOOKUP_SORTED;
+	unsigned bench_runs = 0;
+	unsigned jobs = 1;
+	const char *ini_file, *out_file;
+	const char *dat_file = NULL;
+	const char *cache_file = NULL;
+	struct parse_cache_s cache;
+	const char *prov_file = NULL;
+	const char *outputs[CACHE_OUTPUTS];
+	int files;
+	struct arena_s arena;
+	int stats = 0;
+	int reproducible = 0;
+	char options[64], stamp[128];
+	uint64_t options_hash, content;
+	struct stat st;
+	int opt;
+	static const struct option long_opts[] = {
+		{ "lookup", required_argument, NULL, 'l' },
+		{ "names", no_argument, NULL, 'n' },
+		{ "cheat-ops", no_argument, NULL, 'c' },
+		{ "compact", no_argument, NULL, 'C' },
+		{ "cache", required_argument, NULL, 'k' },
+		{ "reproducible", no_argument, NULL, 'r' },
+		{ "provenance", required_argument, NULL, 'p' },
+		{ "stats", no_argument, NULL, 's' },
+		{ NULL, 0, NULL, 0 }
+	};
 
-	if(((__int128)e1->crc - (__int128)e2->crc) < 0)
-		return -1;
+	while((opt = getopt_long(argc, argv, "b:Ccd:j:k:l:np:rs", long_opts,
+					NULL)) != -1)
+	{
+		switch(opt)
+		{
+		case 'l':
+			if(strcmp(optarg, "sorted") == 0)
+				lookup = LOOKUP_SORTED;
+			else if(strcmp(optarg, "eytzinger") == 0)
+				lookup = LOOKUP_EYTZINGER;
+			else if(strcmp(optarg, "mphf") == 0)
+				lookup = LOOKUP_MPHF;
+			else if(strcmp(optarg, "btree") == 0)
+				lookup = LOOKUP_BTREE;
+			else if(strcmp(optarg, "split") == 0)
+				lookup = LOOKUP_SPLIT;
+			else
+				goto usage;
+			break;
 
-	if(((__int128)e1->crc - (__int128)e2->crc) > 0)
-		return 1;
+		case 'd':
+			dat_file = optarg;
+			break;
 
-	return ((int)e1->conf.reference - (int)e2->conf.reference);
-}
+		case 'n':
+			names = 1;
+			break;
 
-void remove_dupes(struct rom_entry_s *first, size_t *entries)
-{
-	struct rom_entry_s *r = calloc(*entries, sizeof(struct rom_entry_s));
-	struct rom_entry_s *r_i = r;
-	struct rom_entry_s *last = first + *entries;
+		case 'c':
+			cheat_ops = 1;
+			break;
 
-	assert(r != NULL);
+		case 'C':
+			compact = 1;
+			break;
 
-	for(struct rom_entry_s *e = first; e < last; e++)
-	{
-		memcpy(r_i++, e, sizeof(*e));
+		case 'k':
+			cache_file = optarg;
+			break;
 
-		while(e->crc == (e + 1)->crc)
-		{
-			if((e + 1)->conf.reference == 0)
-			{
-				memcpy(r_i, e + 1, sizeof(*e));
-			}
+		case 'r':
+			reproducible = 1;
+			break;
 
-			e++;
+		case 'p':
+			prov_file = optarg;
+			break;
+
+		case 's':
+			stats = 1;
+			break;
+
+		case 'b':
+			bench_runs = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+
+		case 'j':
+			jobs = (unsigned)strtoul(optarg, NULL, 10);
+			if(jobs == 0)
+				jobs = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+			break;
+
+		default:
+			goto usage;
 		}
 	}
 
-	*entries = (r_i - r);
-	memcpy(first, r, *entries * sizeof(*r));
-	last = first + *entries;
+	/* Any number of ini files, then the header. */
+	files = argc - optind - 1;
+	if(files < 1 || files > UINT16_MAX)
+		goto usage;
+
+	ini_file = argv[optind];
+	out_file = argv[argc - 1];
+
+	/* Provenance is only written when merging. */
+	outputs[0] = out_file;
+	outputs[1] = dat_file;
+	outputs[2] = files > 1 ? prov_file : NULL;
+
+	/* Everything read from the first ini is allocated from the arena. */
+	arena_init(&arena);
+	cheats.arena = &arena;
+
+	/* Options that change the output. */
+	snprintf(options, sizeof(options), "%d %d %d %d %d %d", CACHE_VERSION,
+			(int)lookup, names, cheat_ops, compact, reproducible);
+	options_hash = hash_bytes(0, options, strlen(options));
 
-	/* Remove entries that only use defaults. */
-	r_i = r;
-	for(struct rom_entry_s *e = first; e < last; e++)
+	/* Pipes cannot be mapped, so are read as a stream. */
+	if(strcmp(ini_file, "-") == 0 ||
+			(stat(ini_file, &st) == 0 && !S_ISREG(st.st_mode)))
 	{
-		if(e->conf.status != 0 || e->conf.save_type != SAVE_NONE ||
-			e->conf.players != 4 || e->conf.rumble != 1 ||
-			e->conf.transferpak != 0 || e->conf.mempak != 1 ||
-			e->conf.biopak != 0 || e->conf.count_per_op != 2 ||
-			e->conf.disable_extra_mem != 0 ||
-			e->conf.si_dma_duration != 0 || e->conf.reference != 1)
+		content = options_hash;
+		if(read_stream(ini_file, &table, &cheats, &arena,
+					&content) != 0)
 		{
-			memcpy(r_i++, e, sizeof(*e));
+			arena_free(&arena);
+			return EXIT_FAILURE;
 		}
-	}
 
-	*entries = (r_i - r);
-	memcpy(first, r, *entries * sizeof(*r));
-	free(r);
-}
+		if(cache_file != NULL || bench_runs != 0)
+		{
+			fprintf(stderr, "WARNING: The cache and parsing benchmark"
+					" are not used for streams\n");
+			cache_file = NULL;
+		}
 
-void dump_filtered_ini(struct rom_entry_s *all, size_t entries)
-{
-	FILE *f = fopen("fil.ini", "w");
+		memset(&idx, 0, sizeof(idx));
+		ini.buf = NULL;
+		ini.len = 0;
+		goto convert;
+	}
 
-	assert(f != NULL);
+	/* Map ini file. */
+	if(map_file(ini_file, &ini) != 0)
+		return EXIT_FAILURE;
 
-	for(size_t i = 0; i < entries; i++)
+	/* Line offsets are stored as 32-bit values. */
+	if(ini.len > UINT32_MAX)
 	{
-		fprintf(f, "[%s]\n", all[i].track.md5);
-		fprintf(f, "GoodName=%s\n", all[i].track.goodname);
-		fprintf(f, "CRC=0x%016"PRIX64"\n", all[i].crc);
-		if(all[i].conf.reference)
-			fprintf(f, "RefMD5=%s\n", all[i].track.refmd5);
+		fprintf(stderr, "ERR: %s is too large\n", ini_file);
+		unmap_file(&ini);
+		return EXIT_FAILURE;
+	}
 
-		fprintf(f, "\n");
+	if(bench_runs != 0)
+	{
+		bench_parse(&ini, bench_runs, jobs);
+		bench_sort();
 	}
 
-	fclose(f);
-}
+	/* Index all lines; the number of sections gives the number of entries
+	 * we must allocate. */
+	ini_scan(ini.buf, ini.len, &idx, &arena);
+	content = hash_lines(options_hash, ini.buf, &idx);
 
-void resolve_deps(struct rom_entry_s *all, size_t entries)
-{
-	for(struct rom_entry_s *e = all; e < all + entries; e++)
+	if(cache_file != NULL)
 	{
-		uint16_t i;
+		cache_load(&cache, cache_file);
+		cache_hash_ini(&cache, ini.buf, &idx, options_hash);
+		for(int i = 1; i < files && cache_file != NULL; i++)
+		{
+			if(cache_hash_overlay(&cache, argv[optind + i]) == 0)
+				continue;
 
-		if(e->conf.reference == 0)
-			continue;
+			fprintf(stderr, "WARNING: The cache is not used for "
+					"streams\n");
+			cache_free(&cache);
+			cache_file = NULL;
+		}
 
-		for(i = 0; i < entries; i++)
+		if(cache_file != NULL)
 		{
-			if(memcmp(e->track.refmd5, all[i].track.md5, 32) == 0)
-				break;
+			cache_hash_outputs(&cache, outputs,
+					getenv("SOURCE_DATE_EPOCH"));
 		}
 
-		e->conf.reference_entry = i;
-		e->track.refcrc = all[i].crc;
+		/* A benchmark also rewrites the header, so is always run. */
+		if(bench_runs == 0 && cache_file != NULL &&
+				cache_up_to_date(&cache, outputs))
+		{
+			printf("%s is up to date\n", out_file);
+			cache_free(&cache);
+			arena_free(&arena);
+			unmap_file(&ini);
+			return EXIT_SUCCESS;
+		}
 	}
-}
 
-int main(int argc, char *argv[])
-{
-	size_t entries;
-	char *ini;
-	struct rom_entry_s *all;
+	printf("Processing %zu entries\n", idx.sections);
+	convert_entries(ini.buf, &idx, jobs, &table, &cheats, &arena,
+			cache_file != NULL ? &cache : NULL);
+	if(cache_file != NULL)
+	{
+		printf("Parse cache: %zu of %zu sections reused\n", cache.hits,
+				idx.sections);
+	}
 
-	if(argc != 3)
+convert:
+	if(files > 1)
 	{
-		fprintf(stderr,
-		        "Usage: mupenini2dat mupen64plus.ini rom_dat.h\n");
-		return EXIT_FAILURE;
+		struct md5_map_s map;
+		struct prov_log_s prov = { 0 };
+
+		/* Later files take precedence, key by key. */
+		md5_map_init(&map, table.entries);
+		for(size_t i = 0; i < table.entries; i++)
+			md5_map_insert(&map, table.md5[i], (uint32_t)i);
+
+		for(int i = 1; i < files; i++)
+		{
+			const size_t keys = prov.n, entries = table.entries;
+
+			if(merge_overlay(argv[optind + i], (unsigned)i, &table,
+						&cheats, &map, &prov,
+						&content) != 0)
+				return EXIT_FAILURE;
+
+			printf("Merged %s: %zu keys, %zu new entries\n",
+					argv[optind + i], prov.n - keys,
+					table.entries - entries);
+		}
+
+		drop_unused_keys(&table, &prov, argv + optind);
+		if(prov_file != NULL)
+			dump_provenance(prov_file, &table, &prov, argv + optind);
+
+		md5_map_free(&map);
+		free(prov.recs);
 	}
 
-	/* Load ini file. */
-	ini = read_entire_file(argv[1]);
-	if(ini == NULL)
+	make_stamp(stamp, sizeof(stamp), reproducible, content);
+	sort_table(&table);
+	resolve_deps(&table);
+	remove_dupes(&table);
+	ref_index = remap_refs(&table);
+	compute_layout(&table, lookup, &layout);
+
+	/* rom_dat[] refers to other entries by a 16-bit index. */
+	if(check_refs(&table, ref_index, layout.pos, out_file) != 0)
 		return EXIT_FAILURE;
 
-	/* Obtain number of entries; it gives an idea as to how much memory we
-	 * must allocate. */
-	entries = get_num_entries(ini);
+	if(cheat_ops)
+	{
+		build_cheat_ops(&cheats, &ops);
+		printf("Cheat codes: %zu in %zu cheats\n", ops.nops,
+				ops.cheats - 1);
+	}
+
+	/* Cheat strings are only written if they are not parsed. */
+	if(names)
+	{
+		build_pool(&table, cheat_ops ? NULL : &cheats, &pool);
+		printf("String pool: %zu strings in %zu bytes, %zu bytes "
+				"unmerged\n", pool.strings, pool.len, pool.input);
+	}
+
+	dump_header(out_file, stamp, &table, ref_index, &layout, &cheats,
+			names ? &pool : NULL, cheat_ops ? &ops : NULL, compact);
 
-	printf("Processing %zu entries\n", entries);
-	all = convert_entries(ini, entries);
+	if(dat_file != NULL &&
+			dump_binary(dat_file, &table, ref_index, &cheats) != 0)
+		return EXIT_FAILURE;
 
-	qsort(all, entries, sizeof(*all), compare_entry);
-	resolve_deps(all, entries);
-	remove_dupes(all, &entries);
-	dump_header(argv[2], all, entries);
+	dump_filtered_ini(&table);
 
-	dump_filtered_ini(all, entries);
+	if(cache_file != NULL)
+	{
+		cache_save(&cache, cache_file, outputs);
+		cache_free(&cache);
+	}
 
-	/* Free allocations. */
-	for(size_t i = 1; i < cheats_tot; i++)
+	if(bench_runs != 0)
 	{
-		free(cheats_used_by[i]);
-		free(cheats[i]);
+		bench_dump(out_file, stamp, &table, ref_index, &layout, &cheats,
+				names ? &pool : NULL, cheat_ops ? &ops : NULL,
+				compact, bench_runs);
 	}
 
-	free(all);
-	free(ini);
+	if(bench_runs != 0)
+		bench_lookup(&table);
+
+	/* Free allocations. The table, cheats and line index are all in the
+	 * arena. */
+	if(names)
+		free_pool(&pool);
+
+	if(cheat_ops)
+		free_cheat_ops(&ops);
+
+	free_layout(&layout);
+	free(ref_index);
+	arena_free(&arena);
+	unmap_file(&ini);
+
+	if(stats)
+	{
+		printf("Arena: %zu allocations of %zu bytes in %zu chunks\n",
+				arena_stats.allocs, arena_stats.requested,
+				arena_stats.chunks);
+		printf("  %zu bytes reserved in total, %zu bytes at peak\n",
+				arena_stats.reserved, arena_stats.peak);
+	}
 
 	return EXIT_SUCCESS;
+
+usage:
+	fprintf(stderr,
+	        "Usage: mupenini2dat [-b runs] [-d rom.dat] [-j jobs] "
+	        "[--lookup=type] [-n] [-c] [-C]\n"
+	        "                    [--cache=file] [-r] [-p file] [-s]\n"
+	        "                    mupen64plus.ini|- [override.ini...] "
+	        "rom_dat.h\n"
+	        "  -b runs  Benchmark parsing of the ini over the given number "
+	        "of runs,\n"
+	        "           and sorting of synthetic catalogues\n"
+	        "  -d file  Also write the table as a binary database, see "
+	        "romdb.h\n"
+	        "  -j jobs  Parse the ini using the given number of threads, "
+	        "or one per CPU if 0\n"
+	        "  -l, --lookup=type\n"
+	        "           Order of rom_crc[] in the header: sorted (default),"
+	        " eytzinger, mphf,\n"
+	        "           btree or split\n"
+	        "  -n, --names\n"
+	        "           Also write the goodnames, sharing a string pool with"
+	        " the cheats\n"
+	        "  -c, --cheat-ops\n"
+	        "           Write cheats as parsed codes instead of strings\n"
+	        "  -C, --compact\n"
+	        "           Write rom_dat[] as packed 32-bit values\n"
+	        "  -k, --cache=file\n"
+	        "           Keep the parsed sections in the given file, and only"
+	        " parse the\n"
+	        "           sections that changed since. If nothing changed, the"
+	        " outputs are\n"
+	        "           left as they are\n"
+	        "  -r, --reproducible\n"
+	        "           Stamp the header with a hash of the ini instead of the"
+	        " time, unless\n"
+	        "           SOURCE_DATE_EPOCH is set\n"
+	        "  -p, --provenance=file\n"
+	        "           Write which override ini each key was last set by\n"
+	        "  -s, --stats\n"
+	        "           Report the memory allocated while converting\n");
+	return EXIT_FAILURE;
 }
 // kate: indent-mode cstyle; indent-width 8; replace-tabs off; tab-width 8;
@@ -0,0 +1,179 @@
+/**
+ * Reader for the binary ROM database written by mupenini2dat -d.
+ * Copyright (c) 2020 Mahyar Koshkouei <mk@deltabeard.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+ * THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "romdb.h"
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+#else
+	return (uint64_t)get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+#endif
+}
+
+/**
+ * Check that the array at off of n elements of the given size lies within the
+ * file.
+ */
+static int in_bounds(size_t len, uint32_t off, uint32_t n, size_t size)
+{
+	return off <= len && (len - off) / size >= n;
+}
+
+int romdb_load(struct romdb_s *db, const void *buf, size_t len)
+{
+	const uint8_t *b = buf;
+	uint32_t crc_off, conf_off, cheat_off, pool_off;
+
+	if(len < ROMDB_HEADER_SIZE || memcmp(b, ROMDB_MAGIC, 8) != 0 ||
+			get_le32(b + 8) != ROMDB_VERSION)
+		return -1;
+
+	db->entries = get_le32(b + 12);
+	db->cheats = get_le32(b + 16);
+	crc_off = get_le32(b + 20);
+	conf_off = get_le32(b + 24);
+	cheat_off = get_le32(b + 28);
+	pool_off = get_le32(b + 32);
+	db->pool_len = get_le32(b + 36);
+
+	if(!in_bounds(len, crc_off, db->entries, 8) ||
+			!in_bounds(len, conf_off, db->entries, 4) ||
+			!in_bounds(len, cheat_off, db->cheats, 4) ||
+			!in_bounds(len, pool_off, db->pool_len, 1))
+		return -1;
+
+	/* The pool must end with a null terminator, so that every cheat is
+	 * terminated. */
+	if(db->pool_len == 0 || b[pool_off + db->pool_len - 1] != '\0')
+		return -1;
+
+	db->crc = b + crc_off;
+	db->conf = b + conf_off;
+	db->cheat = b + cheat_off;
+	db->pool = (const char *)b + pool_off;
+	return 0;
+}
+
+int romdb_open(struct romdb_s *db, const char *filename)
+{
+	struct stat st;
+	void *p;
+	int fd = open(filename, O_RDONLY);
+
+	db->map = NULL;
+	db->map_len = 0;
+
+	if(fd < 0)
+		return -1;
+
+	if(fstat(fd, &st) != 0 || st.st_size < ROMDB_HEADER_SIZE)
+	{
+		close(fd);
+		return -1;
+	}
+
+	p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(p == MAP_FAILED)
+		return -1;
+
+	if(romdb_load(db, p, (size_t)st.st_size) != 0)
+	{
+		munmap(p, (size_t)st.st_size);
+		return -1;
+	}
+
+	db->map = p;
+	db->map_len = (size_t)st.st_size;
+	return 0;
+}
+
+void romdb_close(struct romdb_s *db)
+{
+	if(db->map != NULL)
+		munmap(db->map, db->map_len);
+
+	memset(db, 0, sizeof(*db));
+}
+
+uint32_t romdb_conf(const struct romdb_s *db, uint32_t entry)
+{
+	return get_le32(db->conf + (size_t)entry * 4);
+}
+
+int32_t romdb_find(const struct romdb_s *db, uint64_t crc)
+{
+	uint32_t lo = 0, hi = db->entries;
+	uint32_t conf;
+
+	while(lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if(get_le64(db->crc + (size_t)mid * 8) < crc)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if(lo == db->entries || get_le64(db->crc + (size_t)lo * 8) != crc)
+		return -1;
+
+	/* References always point to an entry holding a configuration. */
+	conf = romdb_conf(db, lo);
+	if(ROMDB_REFERENCE(conf))
+	{
+		lo = ROMDB_REFERENCE_ENTRY(conf);
+		if(lo >= db->entries)
+			return -1;
+	}
+
+	return (int32_t)lo;
+}
+
+const char *romdb_cheat(const struct romdb_s *db, uint32_t lut)
+{
+	uint32_t off;
+
+	if(lut >= db->cheats)
+		return NULL;
+
+	off = get_le32(db->cheat + (size_t)lut * 4);
+	if(off >= db->pool_len)
+		return NULL;
+
+	return db->pool + off;
+}
@@ -0,0 +1,122 @@
+/**
+ * Reader for the binary ROM database written by mupenini2dat -d.
+ * Copyright (c) 2020 Mahyar Koshkouei <mk@deltabeard.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF
+ * THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * File layout. All values are little-endian.
+ *
+ *  Offset            Contents
+ *  0                 Header, ROMDB_HEADER_SIZE bytes.
+ *  crc_off           uint64_t crc[entries], sorted in ascending order.
+ *  conf_off          uint32_t conf[entries], packed as described below.
+ *  cheat_off         uint32_t cheat[cheats], offset of each cheat in the pool.
+ *  pool_off          Null terminated cheat strings, pool_len bytes.
+ *
+ * Header:
+ *  0   char     magic[8]     ROMDB_MAGIC
+ *  8   uint32_t version      ROMDB_VERSION
+ *  12  uint32_t entries
+ *  16  uint32_t cheats       Including the empty cheat at index 0.
+ *  20  uint32_t crc_off
+ *  24  uint32_t conf_off
+ *  28  uint32_t cheat_off
+ *  32  uint32_t pool_off
+ *  36  uint32_t pool_len
+ *  40  uint32_t reserved[2]  Zero.
+ */
+#define ROMDB_MAGIC		"N64ROMDB"
+#define ROMDB_VERSION		1
+#define ROMDB_HEADER_SIZE	48
+
+/**
+ * Bit positions of the fields of a packed conf value. These match the layout
+ * of the rom_entry_s bit-fields in rom_dat.h on little-endian targets.
+ *
+ * If ROMDB_REFERENCE is set, the only other field is ROMDB_REFERENCE_ENTRY,
+ * which is the index of the entry holding the configuration. As this is 16
+ * bits wide, mupenini2dat refuses to write a database in which a reference
+ * target is past entry 65535.
+ */
+#define ROMDB_REFERENCE(c)		((c) & 0x1)
+#define ROMDB_REFERENCE_ENTRY(c)	(((c) >> 16) & 0xFFFF)
+#define ROMDB_SAVE_TYPE(c)		(((c) >> 1) & 0x7)
+#define ROMDB_PLAYERS(c)		(((c) >> 4) & 0x7)
+#define ROMDB_RUMBLE(c)			(((c) >> 7) & 0x1)
+#define ROMDB_TRANSFERPAK(c)		(((c) >> 8) & 0x1)
+#define ROMDB_STATUS(c)			(((c) >> 9) & 0x7)
+#define ROMDB_COUNT_PER_OP(c)		(((c) >> 12) & 0x7)
+#define ROMDB_DISABLE_EXTRA_MEM(c)	(((c) >> 15) & 0x1)
+#define ROMDB_CHEAT_LUT(c)		((((c) >> 16) & 0x1F) | \
+					(((c) >> 25) & 0x7F) << 5)
+#define ROMDB_MEMPAK(c)			(((c) >> 21) & 0x1)
+#define ROMDB_BIOPAK(c)			(((c) >> 22) & 0x1)
+#define ROMDB_SI_DMA_DURATION(c)	(((c) >> 23) & 0x1)
+#define ROMDB_AI_DMA_MODIFIER(c)	(((c) >> 24) & 0x1)
+
+struct romdb_s
+{
+	/* Mapping of the file, if opened with romdb_open(). */
+	void *map;
+	size_t map_len;
+
+	uint32_t entries;
+	uint32_t cheats;
+	const uint8_t *crc;
+	const uint8_t *conf;
+	const uint8_t *cheat;
+	const char *pool;
+	uint32_t pool_len;
+};
+
+/**
+ * Use a database that is already in memory. The buffer must remain valid until
+ * the database is no longer used.
+ * Returns 0 on success, or -1 if the buffer is not a valid database.
+ */
+int romdb_load(struct romdb_s *db, const void *buf, size_t len);
+
+/**
+ * Map a database file into memory.
+ * Returns 0 on success, or -1 on error.
+ */
+int romdb_open(struct romdb_s *db, const char *filename);
+
+/**
+ * Unmap a database opened with romdb_open().
+ */
+void romdb_close(struct romdb_s *db);
+
+/**
+ * Find the entry of a ROM by its CRC, where crc is (CRC1 << 32) | CRC2.
+ * References are followed, so the returned entry holds the configuration.
+ * Returns the index of the entry, or -1 if the ROM is not in the database.
+ */
+int32_t romdb_find(const struct romdb_s *db, uint64_t crc);
+
+/**
+ * Returns the packed conf value of an entry.
+ */
+uint32_t romdb_conf(const struct romdb_s *db, uint32_t entry);
+
+/**
+ * Returns the cheat string at the given index of the look-up table, or NULL if
+ * the index is invalid. Index 0 is the empty string.
+ */
+const char *romdb_cheat(const struct romdb_s *db, uint32_t lut);